@@ -33,7 +33,14 @@ namespace Voxels {
     // We cannot use the flipped uvs because then the AO gets messed up -- instead we flip the uv in the frag shader
     // const float uvData[12] = { 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 0 }; // Flipped vertically to make texture right side up
     // const float uvData[12] = { 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1 };
-    const char uvData[12] = { 0, 0xf, 0, 0, 0xf, 0xf, 0, 0, 0xf, 0, 0xf, 0xf };
+    const char uvData[12] = { 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1 }; // In blocks, see addQuad
+    // Which axis (x = 0, y = 1, z = 2) the u and v of each face run along
+    const int uvAxes[6][2] = { { 0, 1 }, { 0, 1 }, { 2, 1 }, { 2, 1 }, { 0, 2 }, { 0, 2 } };
+
+    // Every face in faceVertexData is the triangles (0, 1, 2) and (3, 4, 5), where vertex 3 repeats 1 and vertex 5 repeats 2
+    // So a quad only needs vertices 0, 1, 2 and 4, and quadIndices rebuilds the same two triangles (same diagonal) from them
+    const int quadCorners[4] = { 0, 1, 2, 4 };
+    const GLuint quadIndices[6] = { 0, 1, 2, 1, 3, 2 };
 
     const int TOTAL_NUM_BLOCK_TYPES = 4;
     const char atlasLUT[TOTAL_NUM_BLOCK_TYPES + 1][6] = {
@@ -45,57 +52,96 @@ namespace Voxels {
         { 6, 6, 6, 6, 6, 6 }  // glass
     };
 
-    Chunk::Chunk(vec3 coords) {
+    Chunk::Chunk(vec3 coords) : voxels(NUM_VOXELS) { // Starts out as all air, which needs no index array at all
         this->coords = coords;
-        data.assign(NUM_VOXELS, 0); // This takes up 4kb so once u get chunks working, you should move to using files
         drawCount = 0;
         
-        numNeighbors = 0;
-        numFilledNeighbors = 0;
-        numPopulatedNeighbors = 0;
-        numGeometryGeneratedNeighbors = 0;
-
-        geometryData.reserve(MAX_VERTS * STRIDE);
-
-        VAO = createVAO();
-            glGenBuffers(1, &VBO);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
-                // glBufferData(GL_ARRAY_BUFFER, (MAX_VERTS * STRIDE) * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
-
-                // glVertexAttribPointer(0, POS_ITEMSIZE, GL_FLOAT, false, STRIDE * sizeof(float), (void*)0);
-                // glEnableVertexAttribArray(0);
-
-                // glVertexAttribPointer(1, AO_ITEMSIZE, GL_FLOAT, false, STRIDE * sizeof(float), (void*)(POS_ITEMSIZE * sizeof(float)));
-                // glEnableVertexAttribArray(1);
-
-                // glVertexAttribPointer(2, UV_ITEMSIZE, GL_FLOAT, false, STRIDE * sizeof(float), (void*)((POS_ITEMSIZE + AO_ITEMSIZE) * sizeof(float)));
-                // glEnableVertexAttribArray(2);
-
-                // glVertexAttribPointer(3, UV_OFFSET_ITEMSIZE, GL_FLOAT, false, STRIDE * sizeof(float), (void*)((POS_ITEMSIZE + AO_ITEMSIZE + UV_ITEMSIZE) * sizeof(float)));
-                // glEnableVertexAttribArray(3);
+        state = EMPTY;
+        populateDeps = 0;
+        buildDeps = 0;
+
+        pendingMesh = nullptr;
+        spareMesh = nullptr;
+        drawLayout = TRIANGLES;
+        building = false;
+        rebuildPending = false;
+        uploadQueued = false;
+        cancelled = false;
+        for (int f = 0; f < 6; f++) drawFaces[f] = 0;
+
+        for (int i = 0; i < 27; i++) neighbors[i] = nullptr;
+        neighbors[neighborIndex(0, 0, 0)] = this;
+
+        // The arena allocation is only made once the chunk actually has a mesh to upload,
+        // so all-air and fully buried chunks never cost any of it
+    }
+    Chunk::~Chunk() {
+        delete pendingMesh.load();
+        delete spareMesh.load();
+    }
+    long long Chunk::meshBytes() {
+        long long bytes = 0;
+        ChunkMesh* pending = pendingMesh;
+        ChunkMesh* spare = spareMesh;
+        if (pending != nullptr) bytes += pending->data.capacity() * sizeof(GLuint);
+        if (spare != nullptr) bytes += spare->data.capacity() * sizeof(GLuint);
+        return bytes;
+    }
 
-                glBufferData(GL_ARRAY_BUFFER, (MAX_VERTS * STRIDE) * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    void Chunk::setVoxel(vec3 local, char blockType) {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        voxels.set(local.x + (local.y * chunkDims.x) + (local.z * chunkDims.x * chunkDims.y), blockType);
+    }
+    char Chunk::getVoxel(vec3 local) {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        return voxels.get(local.x + (local.y * chunkDims.x) + (local.z * chunkDims.x * chunkDims.y));
+    }
 
-                glVertexAttribPointer(0, 4, GL_INT_2_10_10_10_REV, GL_FALSE, STRIDE * sizeof(GLuint), (void*)0);
-                glEnableVertexAttribArray(0);
-                
-                // ...IPointer, no normalize
-                // glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, STRIDE * sizeof(GLuint), (void*)0);
-                // glEnableVertexAttribArray(0);
+    char Chunk::getVoxelLinked(int x, int y, int z) {
+        int w = chunkDims.x, h = chunkDims.y, d = chunkDims.z;
+        int nx = (x >= w) - (x < 0);
+        int ny = (y >= h) - (y < 0);
+        int nz = (z >= d) - (z < 0);
+        Chunk* chunk = neighbors[neighborIndex(nx, ny, nz)];
+        if (chunk == nullptr) return 0;
+        std::lock_guard<std::mutex> lock(chunk->voxelMutex); // The neighbor may be written by another worker
+        return chunk->voxels.get((x - nx * w) + (y - ny * h) * w + (z - nz * d) * w * h);
+    }
 
-                // ...IPointer, no normalize
-                glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, STRIDE * sizeof(GLuint), (void*)(sizeof(GLuint)));
-                glEnableVertexAttribArray(1);
+    bool Chunk::isUniform() {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        return voxels.isUniform();
+    }
+    char Chunk::getUniformBlock() {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        return voxels.palette[0];
     }
 
-    void Chunk::setVoxel(vec3 local, char blockType) {
-        data.at(local.x + (local.y * chunkDims.x) + (local.z * chunkDims.x * chunkDims.y)) = blockType;
+    void Chunk::getVoxels(char* out) {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        voxels.decode(out);
     }
-    char Chunk::getVoxel(vec3 local) {
-        return data.at(local.x + (local.y * chunkDims.x) + (local.z * chunkDims.x * chunkDims.y));
+    void Chunk::setVoxels(const char* in) {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        voxels.encode(in);
+    }
+    void Chunk::copyVoxels(int fromX, int fromY, int fromZ, int toX, int toY, int toZ, char* out, int strideY, int strideZ) {
+        std::lock_guard<std::mutex> lock(voxelMutex);
+        int w = chunkDims.x, h = chunkDims.y;
+        for (int z = fromZ; z < toZ; z++) {
+            for (int y = fromY; y < toY; y++) {
+                char* row = out + (y - fromY) * strideY + (z - fromZ) * strideZ;
+                if (voxels.isUniform()) {
+                    std::fill(row, row + (toX - fromX), voxels.palette[0]);
+                    continue;
+                }
+                for (int x = fromX; x < toX; x++) row[x - fromX] = voxels.get(x + y * w + z * w * h);
+            }
+        }
     }
     
-    int Chunk::addCubeFace(int faceId, char blockType, vec3 local, char N[3][3][3]) {
+    // Packs the AO of the face's 4 corners as v00 | v01 << 2 | v10 << 4 | v11 << 6
+    int Chunk::getFaceAO(int faceId, char N[3][3][3]) {
         bool top, left, bottom, right, topLeft, topRight, bottomLeft, bottomRight;
 
         switch (faceId) {
@@ -108,12 +154,22 @@ namespace Voxels {
         }
 
         // From https://0fps.net/2013/07/03/ambient-occlusion-for-minecraft-like-worlds/
-        char v00 = top && left ? 0 : (3 - top - left - topLeft);
-        char v01 = top && right ? 0 : (3 - top - right - topRight);
-        char v10 = bottom && left ? 0 : (3 - bottom - left - bottomLeft);
-        char v11 = bottom && right ? 0 : (3 - bottom - right - bottomRight);
+        int v00 = top && left ? 0 : (3 - top - left - topLeft);
+        int v01 = top && right ? 0 : (3 - top - right - topRight);
+        int v10 = bottom && left ? 0 : (3 - bottom - left - bottomLeft);
+        int v11 = bottom && right ? 0 : (3 - bottom - right - bottomRight);
 
-        for (int i = 0; i < 6; i++) {
+        return v00 | (v01 << 2) | (v10 << 4) | (v11 << 6);
+    }
+
+    int Chunk::addCubeFace(std::vector<GLuint> &geometry, int faceId, char blockType, vec3 local, char N[3][3][3], bool indexed) {
+        return addQuad(geometry, faceId, atlasLUT[blockType][faceId], getFaceAO(faceId, N), local, vec3(1.0), indexed);
+    }
+
+    int Chunk::addQuad(std::vector<GLuint> &geometry, int faceId, int atlasIndex, int ao, vec3 origin, vec3 size, bool indexed) {
+        int numVerts = indexed ? 4 : 6;
+        for (int v = 0; v < numVerts; v++) {
+            int i = indexed ? quadCorners[v] : v;
             int e = i * 3;
 
             // 2_10_10_10 (2 is blank)
@@ -125,40 +181,50 @@ namespace Voxels {
             // Idea: If you use unsigned int, maybe you can just add 16 for the sticking-out buffer thingie
             // 16 * 32(more detail) = 512, + 16 = still fits inside 10 bit uint (1024)
 
-            int ix = (faceVertexData[faceId][e] + local.x) * 16.0;
-            int iy = (faceVertexData[faceId][e + 1] + local.y) * 16.0;
-            int iz = (faceVertexData[faceId][e + 2] + local.z) * 16.0;
+            // faceVertexData is all 0s and 1s, so scaling it by size stretches the face over the whole quad
+            int ix = (faceVertexData[faceId][e] * size.x + origin.x) * 16.0;
+            int iy = (faceVertexData[faceId][e + 1] * size.y + origin.y) * 16.0;
+            int iz = (faceVertexData[faceId][e + 2] * size.z + origin.z) * 16.0;
 
             GLuint packedPosition = ix & 0x3ff;
             packedPosition |= (iy & 0x3ff) << 10;
             packedPosition |= (iz & 0x3ff) << 20;
 
-            geometryData.push_back(packedPosition);
+            geometry.push_back(packedPosition);
 
 
             e = i * 2;
 
-            // 4_4_8_2_2_2_2
-            // Since these are all chars, all positive integers (we assume char is unsigned)
-            // and these are guaranteed to all be within their appropriate ranges,
-            // we dont have to do the & operation
+            // 5_5_8_8 (u, v, atlas index, AO)
+            // UVs are in blocks rather than 0~1 so that merged quads repeat the texture (and the AO) once per block,
+            // 5 bits fits a quad spanning the whole chunk (0~16)
+            // These are all guaranteed to be within their appropriate ranges, so we dont have to do the & operation
 
             //  pass in offset as (uvx + offset) / 12,
             // To do that, since we cant pass a float, if we do a division by non multiple of two then we lose precision
             // Just make num atlas faces be multiple of two
 
-            GLuint packedUVAO = uvData[e];
-            packedUVAO |= uvData[e + 1] << 4;
+            GLuint packedUVAO = uvData[e] * (int)size[uvAxes[faceId][0]];
+            packedUVAO |= (uvData[e + 1] * (int)size[uvAxes[faceId][1]]) << 5;
 
-            packedUVAO |= atlasLUT[blockType][faceId] << 8;
+            packedUVAO |= atlasIndex << 10;
+            packedUVAO |= ao << 18;
 
-            packedUVAO |= v00 << 16;
-            packedUVAO |= v01 << 18;
-            packedUVAO |= v10 << 20;
-            packedUVAO |= v11 << 24;
-
-            geometryData.push_back(packedUVAO);
+            geometry.push_back(packedUVAO);
         }
-        return 6; // Add this to tmpDrawCount
+        return numVerts; // Number of vertices added
+    }
+
+    int Chunk::addFaceRecord(std::vector<GLuint> &geometry, int faceId, char blockType, vec3 local, char N[3][3][3]) {
+        // The corner positions and uvs are looked up by faceId in voxels_faces.vert, so only the voxel's own position is stored
+        GLuint record = (int)local.x;
+        record |= (int)local.y << 4;
+        record |= (int)local.z << 8;
+        record |= faceId << 12;
+        record |= atlasLUT[blockType][faceId] << 15;
+        record |= getFaceAO(faceId, N) << 23;
+
+        geometry.push_back(record);
+        return 6; // Number of vertices this will be drawn with
     }
 }
\ No newline at end of file
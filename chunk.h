@@ -7,10 +7,14 @@
 #include "dependencies/igsi/core/mat4.h"
 #include "dependencies/igsi/core/helpers.h"
 
+#include "paletteStorage.h"
+#include "vertexArena.h"
+
 #include <vector>
 #include <map>
 #include <deque>
 #include <mutex>
+#include <atomic>
 
 namespace Voxels {
     // Technically should be integer vector but whatever
@@ -21,11 +25,39 @@ namespace Voxels {
 
     extern const float faceVertexData[6][18];
     extern const char uvData[12];
+    extern const int uvAxes[6][2];
+    extern const int quadCorners[4];
+    extern const GLuint quadIndices[6];
     
     // https://stackoverflow.com/questions/51939692/c-extern-constant-int-for-array-size
     extern const int TOTAL_NUM_BLOCK_TYPES;
     extern const char atlasLUT[][6]; //[TOTAL_NUM_BLOCK_TYPES + 1]
+
+    // How a chunk's mesh is laid out, each layout is drawn with its own shader program
+    enum MeshLayout {
+        TRIANGLES, // STRIDE GLuints per vertex, 6 vertices per face (see addCubeFace)
+        QUADS, // Same vertex format, but 4 vertices per face, drawn with VertexArena's shared quad index buffer
+        FACES, // One GLuint per face, expanded into 6 vertices by voxels_faces.vert (see addFaceRecord)
+        NUM_MESH_LAYOUTS
+    };
     
+    // Where a chunk is in the pipeline, each step only happens once all neighbors have reached the previous one
+    // Rebuilds go from UPLOADED back to MESHED, but a chunk never goes back below POPULATED
+    enum ChunkState {
+        EMPTY,
+        FILLED, // Terrain generated
+        POPULATED, // Top layer turned to grass, which needs the chunk above to be FILLED
+        MESHED, // Chunk::pendingMesh is up to date, which needs all neighbors to be POPULATED
+        UPLOADED // Drawable
+    };
+
+    // A finished mesh. Never modified while published, see Chunk::pendingMesh
+    struct ChunkMesh {
+        std::vector<GLuint> data;
+        MeshLayout layout;
+        int faces[6]; // The faces are sorted by faceId, these are the number of faces with each faceId
+    };
+
     class Chunk {
     private:
         // https://stackoverflow.com/questions/3531060/how-to-initialize-a-static-const-member-in-c
@@ -38,26 +70,68 @@ namespace Voxels {
         static const GLint STRIDE = 2;
         
         Igsi::vec3 coords;
-        std::vector<char> data;
+        PaletteStorage voxels;
+        std::mutex voxelMutex; // Guards voxels against being widened or re-encoded mid-read, every accessor below takes it
         int drawCount;
         
-        int numNeighbors;
-        int numFilledNeighbors;
-        int numPopulatedNeighbors;
-        int numGeometryGeneratedNeighbors;
+        std::atomic<int> state; // A ChunkState
+        // Number of chunks (this one and its neighbors) that still have to be FILLED before this can be populated, or POPULATED before it can be meshed
+        // 0 means it isn't waiting anymore. Set up by ChunkManager::addChunk and counted down by ChunkUpdater
+        std::atomic<int> populateDeps;
+        std::atomic<int> buildDeps;
+
+        // Links to the 26 surrounding chunks (nullptr where there is none), kept up to date by ChunkManager::addChunk/deleteChunk
+        // Indexed by neighborIndex, the middle entry links to the chunk itself so offsets of 0 need no special case
+        std::atomic<Chunk*> neighbors[27];
+        static int neighborIndex(int nx, int ny, int nz) { return (nx + 1) + (ny + 1) * 3 + (nz + 1) * 9; } // Each offset is -1, 0 or 1
+        static int oppositeIndex(int index) { return 26 - index; }
+
+        ArenaAllocation mesh; // Where the uploaded mesh lives in ChunkManager::vertexArena
 
-        GLuint VAO;
-        GLuint VBO;
+        // Meshes are handed from the mesh workers to the render thread by swapping pointers, so neither ever waits on the other:
+        // a worker builds into a ChunkMesh nobody else can see, then publishes it with one exchange on pendingMesh,
+        // and the render thread takes it with another. Whoever swaps a mesh out owns it from then on
+        // Once uploaded, the mesh goes to spareMesh so the next build can reuse its storage. That's at most 3 per chunk, one of which is being built
+        std::atomic<ChunkMesh*> pendingMesh; // Built but not uploaded yet
+        std::atomic<ChunkMesh*> spareMesh;
+        MeshLayout drawLayout; // Layout of the uploaded mesh, only touched by the render thread
+        int drawFaces[6]; // ChunkMesh::faces of the uploaded mesh, so drawChunks can skip the directions that face away from the camera
 
-        // std::vector<float> geometryData;
-        std::vector<GLuint> geometryData;
+        std::atomic<bool> building; // A mesh worker is building this chunk, see ChunkUpdater::buildNext
+        std::atomic<bool> rebuildPending; // A build was requested while building, so the worker does another pass
+        std::atomic<bool> uploadQueued; // In ChunkUpdater::mapQueue or ChunkUpdater::uploadQueue
+        std::atomic<bool> cancelled; // Unloaded by ChunkManager::deleteChunk, so jobs still holding it should stop
 
         Chunk(Igsi::vec3 coords);
+        ~Chunk();
+        long long meshBytes(); // Held by pendingMesh and spareMesh. Only exact while no worker is publishing
+
 
         void setVoxel(Igsi::vec3 local, char blockType);
         char getVoxel(Igsi::vec3 local);
+        // Like getVoxel, but local may be up to one chunk out of bounds in any direction, which reads through the neighbor links
+        // Voxels in missing neighbors read as air. Locks one voxelMutex per call, so prefer copyVoxels for more than a few voxels
+        char getVoxelLinked(int x, int y, int z);
+
+        // A uniform chunk is entirely one block type and stores no voxel array
+        // It stays that way until the first setVoxel with a different block type
+        bool isUniform();
+        char getUniformBlock(); // Only meaningful if isUniform()
+
+        // Bulk access, in the same x, then y, then z order as the voxel index
+        void getVoxels(char* out); // out must hold NUM_VOXELS chars
+        void setVoxels(const char* in);
+        // Copies the local box [from, to) under the voxel lock, voxel (x, y, z) goes to out[(x - fromX) + (y - fromY) * strideY + (z - fromZ) * strideZ]
+        void copyVoxels(int fromX, int fromY, int fromZ, int toX, int toY, int toZ, char* out, int strideY, int strideZ);
 
-        int addCubeFace(int faceId, char blockType, Igsi::vec3 local, char N[3][3][3]);
+        static int getFaceAO(int faceId, char N[3][3][3]);
+        // indexed: only emit the 4 quadCorners of the face, for the QUADS layout
+        int addCubeFace(std::vector<GLuint> &geometry, int faceId, char blockType, Igsi::vec3 local, char N[3][3][3], bool indexed = false);
+        // A face stretched over size blocks starting at origin (size is 1 along the face's normal), used by greedy meshing
+        int addQuad(std::vector<GLuint> &geometry, int faceId, int atlasIndex, int ao, Igsi::vec3 origin, Igsi::vec3 size, bool indexed = false);
+        // Packs the whole face into one GLuint for the FACES layout:
+        // x, y, z in bits 0-11 (4 bits each), faceId in 12-14, atlas index in 15-22, ao in 23-30
+        int addFaceRecord(std::vector<GLuint> &geometry, int faceId, char blockType, Igsi::vec3 local, char N[3][3][3]);
     };
 }
 
@@ -0,0 +1,58 @@
+#include "chunkGrid.h"
+#include "chunk.h"
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <vector>
+
+using namespace Igsi;
+
+namespace Voxels {
+    ChunkGrid::ChunkGrid(int width, int height, int depth) {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        slots.assign(width * height * depth, Slot{ 0, nullptr });
+        count = 0;
+    }
+    ChunkGrid::~ChunkGrid() {
+        for (int i = 0; i < slots.size(); i++) delete slots[i].chunk;
+    }
+
+    // Works on the id's fields directly: they are the coordinates offset by 2^20, so they are never negative,
+    // and the offset just shifts which slot is which, the same for every chunk (see ChunkManager::coordsToId)
+    int ChunkGrid::slotIndex(ChunkId id) {
+        const ChunkId mask = (1 << 21) - 1;
+        int x = (id & mask) % width;
+        int y = ((id >> 21) & mask) % height;
+        int z = ((id >> 42) & mask) % depth;
+        return x + width * (y + height * z);
+    }
+
+    Chunk* ChunkGrid::find(ChunkId id) {
+        Slot &slot = slots[slotIndex(id)];
+        return slot.chunk != nullptr && slot.id == id ? slot.chunk : nullptr;
+    }
+    Chunk* ChunkGrid::insert(ChunkId id, vec3 coords) {
+        Slot &slot = slots[slotIndex(id)];
+        if (slot.chunk != nullptr) return slot.id == id ? slot.chunk : nullptr;
+
+        slot.id = id;
+        slot.chunk = new Chunk(coords);
+        count++;
+        return slot.chunk;
+    }
+    Chunk* ChunkGrid::remove(ChunkId id) {
+        Slot &slot = slots[slotIndex(id)];
+        if (slot.chunk == nullptr || slot.id != id) return nullptr;
+
+        Chunk* chunk = slot.chunk;
+        slot.chunk = nullptr;
+        count--;
+        return chunk;
+    }
+    Chunk* ChunkGrid::occupant(ChunkId id) {
+        Slot &slot = slots[slotIndex(id)];
+        return slot.id != id ? slot.chunk : nullptr;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef VOXELS_CHUNKGRID_H
+#define VOXELS_CHUNKGRID_H
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include "chunkStorage.h"
+
+#include <vector>
+
+namespace Voxels {
+    class Chunk;
+
+    // Fixed size 3D ring buffer of chunks: a chunk's slot is its coordinates modulo the grid size on each axis,
+    // so a lookup is one index computation and a compare, with no hashing or probing
+    // The grid wraps around (it's a torus), so as the view moves, the slots left behind on one side are the ones the new chunks on the other side need
+    // Any width x height x depth box of chunks fits, anything more doesn't: insert returns nullptr and occupant says which chunk is in the way
+    // Meant for streaming around a single viewer, with the grid at least as large as the unload range of ChunkStreamer
+    class ChunkGrid : public ChunkStorage {
+    private:
+        struct Slot {
+            ChunkId id;
+            Chunk* chunk; // nullptr means the slot is empty
+        };
+        std::vector<Slot> slots; // x, then y, then z
+        int width, height, depth;
+        int count;
+
+        int slotIndex(ChunkId id);
+    public:
+        ChunkGrid(int width, int height, int depth); // In chunks
+        ~ChunkGrid();
+        ChunkGrid(const ChunkGrid&) = delete;
+        ChunkGrid& operator = (const ChunkGrid&) = delete;
+
+        Chunk* find(ChunkId id);
+        Chunk* insert(ChunkId id, Igsi::vec3 coords);
+        Chunk* remove(ChunkId id);
+        Chunk* occupant(ChunkId id);
+
+        int size() { return count; }
+        int capacity() { return slots.size(); }
+        Chunk* slot(int i) { return slots[i].chunk; }
+    };
+}
+
+#endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "chunkManager.h"
 #include "chunk.h"
+#include "chunkMap.h"
 #include "gen.h"
 #include "frustum.h"
 
@@ -13,7 +14,10 @@
 #include "dependencies/igsi/core/transform.h"
 
 #include <cmath>
-#include <map>
+#include <cstdint>
+#include <stdexcept>
+#include <mutex>
+#include <shared_mutex>
 #include <algorithm>
 
 #include <iostream>
@@ -21,15 +25,23 @@
 using namespace Igsi;
 
 namespace Voxels {
-    float ChunkManager::coordsToId(vec3 coords) {
-        coords.x = std::fabs(coords.x * 2.0) - (coords.x < 0.0); // Fold function (maps negative & positive integers -> positive integers)
-        coords.y = std::fabs(coords.y * 2.0) - (coords.y < 0.0);
-        coords.z = std::fabs(coords.z * 2.0) - (coords.z < 0.0);
-        // cantorPair(cantorPair(a, b), c) for unique integer for every trio of positive integers
-        float sum = coords.x + coords.y;
-        float cantor1 = 0.5 * sum * (sum + 1) + coords.y;
-        sum = cantor1 + coords.z;
-        return 0.5 * sum * (sum + 1) + coords.z;
+    // Each axis is offset by 2^20 so it fits in 21 unsigned bits, which leaves the top bit of the id unused
+    ChunkId ChunkManager::coordsToId(vec3 coords) {
+        const std::int64_t bias = 1 << 20;
+        const ChunkId mask = (1 << 21) - 1;
+        ChunkId x = (ChunkId)((std::int64_t)coords.x + bias) & mask;
+        ChunkId y = (ChunkId)((std::int64_t)coords.y + bias) & mask;
+        ChunkId z = (ChunkId)((std::int64_t)coords.z + bias) & mask;
+        return x | (y << 21) | (z << 42);
+    }
+    vec3 ChunkManager::idToCoords(ChunkId id) {
+        const std::int64_t bias = 1 << 20;
+        const ChunkId mask = (1 << 21) - 1;
+        return vec3(
+            (std::int64_t)(id & mask) - bias,
+            (std::int64_t)((id >> 21) & mask) - bias,
+            (std::int64_t)((id >> 42) & mask) - bias
+        );
     }
     vec3 ChunkManager::getChunkCoords(vec3 voxel) { return floor(voxel / chunkDims); }
     vec3 ChunkManager::getLocalCoords(vec3 voxel) {
@@ -40,31 +52,137 @@ namespace Voxels {
         );
     }
 
-    Chunk& ChunkManager::addChunk(vec3 coords) {
-        return chunks.emplace(coordsToId(coords), Chunk(coords)).first->second;
+    // 16 MB pages, at most 256 MB of chunk meshes in total
+    ChunkManager::ChunkManager(ChunkStorage* chunks) : vertexArena(16 << 20, 256 << 20) {
+        this->chunks = chunks != nullptr ? chunks : new ChunkMap();
+        epoch = 0;
+        activeJobs[0] = 0;
+        activeJobs[1] = 0;
+    }
+    ChunkManager::~ChunkManager() {
+        for (int i = 0; i < retiredChunks.size(); i++) delete retiredChunks[i].chunk;
+        delete chunks;
+    }
+
+    Chunk* ChunkManager::addChunk(vec3 coords, ChunkState initialState) {
+        std::lock_guard<std::shared_timed_mutex> lock(chunksMutex);
+        int oldSize = chunks->size();
+        Chunk* chunk = chunks->insert(coordsToId(coords), coords);
+        if (chunks->size() == oldSize) return chunk; // Already existed, so it is already linked. Or there was no room
+
+        // The new chunk waits on itself, unless it starts out past that stage
+        chunk->state = initialState;
+        chunk->populateDeps = initialState < FILLED;
+        chunk->buildDeps = initialState < POPULATED;
+
+        // Link the new chunk and its neighbors to each other, in both directions
+        // ChunkUpdater only counts dependencies down under a shared lock, so nothing changes state while we count them up here
+        for (int nz = -1; nz <= 1; nz++) {
+            for (int ny = -1; ny <= 1; ny++) {
+                for (int nx = -1; nx <= 1; nx++) {
+                    if (nx == 0 && ny == 0 && nz == 0) continue;
+                    Chunk* neighbor = chunks->find(coordsToId(coords + vec3(nx, ny, nz)));
+                    if (neighbor == nullptr) continue;
+                    int i = Chunk::neighborIndex(nx, ny, nz);
+                    chunk->neighbors[i] = neighbor;
+                    neighbor->neighbors[Chunk::oppositeIndex(i)] = chunk;
+
+                    // Each waits on the other, but an existing chunk only if it is still waiting at all -- once scheduled it doesn't go back
+                    if (initialState < FILLED && neighbor->state < FILLED) chunk->populateDeps++;
+                    if (neighbor->state < POPULATED) chunk->buildDeps++;
+                    if (initialState < FILLED && neighbor->populateDeps > 0) neighbor->populateDeps++;
+                    if (initialState < POPULATED && neighbor->buildDeps > 0) neighbor->buildDeps++;
+                }
+            }
+        }
+        return chunk;
+    }
+    Chunk* ChunkManager::findChunk(ChunkId id) {
+        std::shared_lock<std::shared_timed_mutex> lock(chunksMutex);
+        return chunks->find(id);
     }
-    bool ChunkManager::hasChunk(float id) {
-        return chunks.find(id) != chunks.end();
+    bool ChunkManager::hasChunk(ChunkId id) {
+        return findChunk(id) != nullptr;
     }
-    Chunk& ChunkManager::getChunk(float id) {
-        return chunks.at(id);
+    Chunk* ChunkManager::findOccupant(ChunkId id) {
+        std::shared_lock<std::shared_timed_mutex> lock(chunksMutex);
+        return chunks->occupant(id);
     }
-    void ChunkManager::deleteChunk(float id) {
-        // std::vector<char>().swap(chunks.at(id).data);
-        chunks.at(id).data.clear();
-        chunks.at(id).data.shrink_to_fit();
-        chunks.erase(id);
+    Chunk& ChunkManager::getChunk(ChunkId id) {
+        Chunk* chunk = findChunk(id);
+        if (chunk == nullptr) throw std::out_of_range("ChunkManager::getChunk: no such chunk");
+        return *chunk;
+    }
+    void ChunkManager::deleteChunk(ChunkId id, std::vector<ChunkId> &readyToPopulate, std::vector<ChunkId> &readyToBuild) {
+        std::lock_guard<std::shared_timed_mutex> lock(chunksMutex);
+        Chunk* chunk = chunks->remove(id);
+        if (chunk == nullptr) return;
+        chunk->cancelled = true;
+
+        // Unlink it in both directions, so nothing reads through a dangling neighbor pointer,
+        // and so that finishing a job on it can't release its old neighbors' dependencies a second time
+        for (int i = 0; i < 27; i++) {
+            Chunk* neighbor = chunk->neighbors[i];
+            chunk->neighbors[i] = nullptr;
+            if (neighbor == nullptr || neighbor == chunk) continue;
+            neighbor->neighbors[Chunk::oppositeIndex(i)] = nullptr;
+
+            // Neighbors still counting on this chunk to be filled or populated would otherwise wait forever
+            // Same rule as in addChunk: a neighbor only counted it if it was still waiting at all
+            ChunkId neighborId = coordsToId(neighbor->coords);
+            if (chunk->state < FILLED && neighbor->populateDeps > 0 && --neighbor->populateDeps == 0) readyToPopulate.push_back(neighborId);
+            if (chunk->state < POPULATED && neighbor->buildDeps > 0 && --neighbor->buildDeps == 0) readyToBuild.push_back(neighborId);
+        }
+        vertexArena.free(chunk->mesh);
+        chunk->drawCount = 0;
+        retiredChunks.push_back(RetiredChunk{ chunk, epoch });
+    }
+    long long ChunkManager::freeRetiredChunks() {
+        // Every job from the previous epoch has ended, so move on
+        int e = epoch;
+        if (activeJobs[(e + 1) & 1] == 0) epoch = ++e;
+
+        long long freedBytes = 0;
+        int kept = 0;
+        for (int i = 0; i < retiredChunks.size(); i++) {
+            Chunk* chunk = retiredChunks[i].chunk;
+            if (e - retiredChunks[i].epoch < 2) {
+                retiredChunks[kept++] = retiredChunks[i];
+                continue;
+            }
+            freedBytes += chunk->meshBytes();
+            delete chunk;
+        }
+        retiredChunks.resize(kept);
+        return freedBytes;
+    }
+    int ChunkManager::numChunks() {
+        std::shared_lock<std::shared_timed_mutex> lock(chunksMutex);
+        return chunks->size();
+    }
+
+    int ChunkManager::beginJob() {
+        // If the epoch moved on before we were counted, freeRetiredChunks may have missed us, so count again under the new one
+        while (true) {
+            int e = epoch;
+            activeJobs[e & 1]++;
+            if (epoch == e) return e;
+            activeJobs[e & 1]--;
+        }
+    }
+    void ChunkManager::endJob(int jobEpoch) {
+        activeJobs[jobEpoch & 1]--;
     }
 
     char ChunkManager::getVoxelGlobal(vec3 voxel) {
-        float id = coordsToId(getChunkCoords(voxel));
-        vec3 local = getLocalCoords(voxel);
-        return hasChunk(id) ? getChunk(id).getVoxel(local) : 0;
+        Chunk* chunk = findChunk(coordsToId(getChunkCoords(voxel)));
+        return chunk != nullptr ? chunk->getVoxel(getLocalCoords(voxel)) : 0;
     }
     void ChunkManager::setVoxelGlobal(vec3 voxel, char blockType) {
         vec3 coords = getChunkCoords(voxel);
         vec3 local = getLocalCoords(voxel);
-        addChunk(coords).setVoxel(local, blockType); // If you try to set voxel in nonexistent chunk, it will create new chunk
+        Chunk* chunk = addChunk(coords, POPULATED); // If you try to set voxel in nonexistent chunk, it will create new chunk
+        if (chunk != nullptr) chunk->setVoxel(local, blockType); // Unless a ChunkGrid has no room for it, then the edit is dropped
     }
 
     // Find more efficient way to raycast
@@ -97,32 +215,93 @@ namespace Voxels {
         normal = vec3(0.0);
         return;
     }
-    void ChunkManager::drawChunks(Transform* camera, mat4 projectionMatrix, Frustum* frustum) {
-        mat4 worldMatrix;
+    int ChunkManager::drawChunks(Transform* camera, Frustum* frustum) {
+        int numVerts = 0;
+
+        // Find the visible chunks first, then draw them one mesh layout at a time, since each layout has its own program
+        visibleChunks.clear();
+        std::shared_lock<std::shared_timed_mutex> lock(chunksMutex);
+        for (int i = 0; i < chunks->capacity(); i++) {
+            Chunk* chunk = chunks->slot(i);
+            if (chunk == nullptr || chunk->drawCount == 0) continue; // Empty slot, or empty or not uploaded yet
 
-        for (auto it = chunks.begin(); it != chunks.end(); ++it) {
             float radius = length(vec3(0.5) * chunkDims); // Should be constant
             vec4 center = vec4(
-                chunkDims.x * (0.5 + it->second.coords.x),
-                chunkDims.y * (0.5 + it->second.coords.y),
-                chunkDims.z * (0.5 + it->second.coords.z),
+                chunkDims.x * (0.5 + chunk->coords.x),
+                chunkDims.y * (0.5 + chunk->coords.y),
+                chunkDims.z * (0.5 + chunk->coords.z),
                 1.0
             );
             center = camera->inverseWorldMatrix * center;
 
-            if (frustum->intersectsSphere(vec3(center.x, center.y, center.z), radius)) {
-                glBindVertexArray(it->second.VAO);
-                GLuint current = getCurrentShaderProgram();
+            if (frustum->intersectsSphere(vec3(center.x, center.y, center.z), radius)) visibleChunks.push_back(chunk);
+        }
+
+        // Every chunk in a page shares its VAO (or buffer texture), and the shaders find each chunk's origin from gl_VertexID (see VertexArena::setOrigin),
+        // so all the chunks of one layout in one page can go in a single multi-draw
+        std::sort(visibleChunks.begin(), visibleChunks.end(), [](Chunk* a, Chunk* b) {
+            if (a->drawLayout != b->drawLayout) return a->drawLayout < b->drawLayout;
+            return a->mesh.page < b->mesh.page;
+        });
+
+        GLuint program = 0;
+        for (int i = 0; i < visibleChunks.size(); ) {
+            int layout = visibleChunks[i]->drawLayout;
+            int page = visibleChunks[i]->mesh.page;
+
+            // The camera comes from the Camera uniform block, which render() fills once per frame
+            if (program != programs[layout]) {
+                program = programs[layout];
+                useProgram(program);
+            }
+            if (layout == FACES) vertexArena.bindFaces(page);
+            else vertexArena.bind(page);
+
+            drawFirsts.clear();
+            drawCounts.clear();
+            drawIndices.clear();
+            for (; i < visibleChunks.size() && visibleChunks[i]->drawLayout == layout && visibleChunks[i]->mesh.page == page; i++) {
+                Chunk* chunk = visibleChunks[i];
 
-                worldMatrix.setTranslation(it->second.coords * chunkDims);
-                setUniform("worldMatrix", worldMatrix, current);
+                // FACES stores one GLuint per face and draws 6 vertices for each, so gl_VertexID / 6 is the index of the face in the page
+                GLint first = layout == FACES
+                    ? chunk->mesh.offset / sizeof(GLuint) * 6
+                    : chunk->mesh.offset / (Chunk::STRIDE * sizeof(GLuint));
 
-                setUniform("viewMatrix", camera->inverseWorldMatrix, current);
-                setUniform("projectionMatrix", projectionMatrix, current);
+                // A face can only be seen from the side its normal points to, and every face lies within the chunk's bounds,
+                // so e.g. when the camera is below the chunk, none of its T faces can be facing it
+                vec3 chunkMin = chunk->coords * chunkDims;
+                vec3 chunkMax = chunkMin + chunkDims;
+                vec3 p = camera->position;
+                bool facing[6] = { p.z > chunkMin.z, p.z < chunkMax.z, p.x > chunkMin.x, p.x < chunkMax.x, p.y > chunkMin.y, p.y < chunkMax.y };
 
-                setUniform("cameraPosition", camera->position, current);
-                glDrawArrays(GL_TRIANGLES, 0, it->second.drawCount);
+                // The buckets are stored in faceId order, so each run of facing buckets is one draw
+                int firstFace = 0;
+                for (int f = 0; f < 6; ) {
+                    if (!facing[f]) {
+                        firstFace += chunk->drawFaces[f++];
+                        continue;
+                    }
+                    int runStart = firstFace;
+                    while (f < 6 && facing[f]) firstFace += chunk->drawFaces[f++];
+                    int count = (firstFace - runStart) * 6; // Vertices, or indices for QUADS
+                    if (count == 0) continue;
+
+                    // QUADS all share the same index buffer, which starts from 0 for every chunk, so the chunk's first vertex goes in as the base vertex
+                    if (layout == QUADS) {
+                        drawFirsts.push_back(first); // Base vertex
+                        drawIndices.push_back((void*)(runStart * 6 * sizeof(GLuint)));
+                    }
+                    else drawFirsts.push_back(first + runStart * 6);
+                    drawCounts.push_back(count);
+                    numVerts += count;
+                }
             }
+
+            if (drawCounts.empty()) continue;
+            if (layout == QUADS) glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawIndices.data(), drawCounts.size(), drawFirsts.data());
+            else glMultiDrawArrays(GL_TRIANGLES, drawFirsts.data(), drawCounts.data(), drawCounts.size());
         }
+        return numVerts;
     }
 }
\ No newline at end of file
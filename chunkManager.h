@@ -7,9 +7,15 @@
 #include "dependencies/igsi/core/mat4.h"
 #include "dependencies/igsi/core/transform.h"
 
-#include <map>
+#include "chunk.h"
+#include "chunkStorage.h"
+#include "vertexArena.h"
+
+#include <vector>
 #include <deque>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 
 namespace Voxels {
     class Chunk;
@@ -17,23 +23,63 @@ namespace Voxels {
     class Frustum;
 
     class ChunkManager {
+    private:
+        // Scratch for drawChunks
+        std::vector<Chunk*> visibleChunks;
+        std::vector<GLint> drawFirsts; // Or base vertices for QUADS
+        std::vector<GLsizei> drawCounts;
+        std::vector<const void*> drawIndices; // QUADS only
+
+        // Deleted chunks are only freed once no job that could still be using them is running (epoch based reclamation)
+        // A job belongs to the epoch it began in, and the epoch only advances once every job from the one before has ended,
+        // so a chunk deleted during epoch e is unreachable by anything once the epoch has reached e + 2
+        struct RetiredChunk {
+            Chunk* chunk;
+            int epoch;
+        };
+        std::atomic<int> epoch;
+        std::atomic<int> activeJobs[2]; // Indexed by epoch parity, only the current and the previous epoch can have jobs
+        std::vector<RetiredChunk> retiredChunks;
     public:
-        static float coordsToId(Igsi::vec3 coords);
+        static ChunkId coordsToId(Igsi::vec3 coords);
+        static Igsi::vec3 idToCoords(ChunkId id);
         static Igsi::vec3 getChunkCoords(Igsi::vec3 voxel);
         static Igsi::vec3 getLocalCoords(Igsi::vec3 voxel);
         
-        std::map<float, Chunk> chunks;
+        ChunkStorage* chunks; // Owned
+        std::shared_timed_mutex chunksMutex; // Lookups share it, adding and deleting chunks (which can rehash the table) take it exclusively
+        VertexArena vertexArena; // Holds the meshes of every chunk
+        GLuint programs[NUM_MESH_LAYOUTS]; // Shader program drawChunks uses for each MeshLayout
+
+        ChunkManager(ChunkStorage* chunks = nullptr); // Takes ownership of chunks, defaults to a ChunkMap
+        ~ChunkManager();
+
+        // Note how this takes a coordinate, not an ID -- MB we should change to ID for consistency?
+        // Chunks that won't be generated (e.g. created by an edit) should start out POPULATED, so their neighbors don't wait on them
+        // Returns nullptr if the storage has no room for it, which a ChunkMap always has
+        Chunk* addChunk(Igsi::vec3 coords, ChunkState initialState = EMPTY);
+        Chunk* findChunk(ChunkId id); // Single probe, nullptr if the chunk doesn't exist -- prefer this over hasChunk + getChunk
+        bool hasChunk(ChunkId id);
+        Chunk* findOccupant(ChunkId id); // The chunk that has to be deleted before id can be added, see ChunkStorage::occupant
+        Chunk &getChunk(ChunkId id); // Throws std::out_of_range if the chunk doesn't exist
+        // Unlinks the chunk right away, but only frees it in a later freeRetiredChunks, see beginJob
+        // Neighbors that were only waiting on this chunk become ready, their ids get appended to readyToPopulate and readyToBuild
+        // Call from the thread with the GL context, since this frees the chunk's mesh in vertexArena
+        void deleteChunk(ChunkId id, std::vector<ChunkId> &readyToPopulate, std::vector<ChunkId> &readyToBuild);
+        long long freeRetiredChunks(); // Call every frame from the same thread. Returns the Chunk::meshBytes freed
+        int numChunks();
 
-        Chunk &addChunk(Igsi::vec3 coords); // Note how this takes a coordinate, not an ID -- MB we should change to ID for consistency?
-        bool hasChunk(float id);
-        Chunk &getChunk(float id);
-        void deleteChunk(float id);
+        // Anything that looks a chunk up on another thread and keeps using it (or its neighbors) afterwards must do so inside a job,
+        // and must expect findChunk to return nullptr for chunks deleted meanwhile
+        int beginJob(); // Returns the job's epoch, pass it to endJob
+        void endJob(int jobEpoch);
 
         char getVoxelGlobal(Igsi::vec3 voxel);
         void setVoxelGlobal(Igsi::vec3 voxel, char blockType); // If you try to set voxel in nonexistent chunk, it will create new chunk
 
         void raycastVoxels(Igsi::vec3 ro, Igsi::vec3 rd, float distance, Igsi::vec3 &voxel, Igsi::vec3 &normal);
-        void drawChunks(Igsi::Transform* camera, Igsi::mat4 projectionMatrix, Frustum* frustum);
+        // One multi-draw per mesh layout and arena page. Returns the number of vertices drawn
+        int drawChunks(Igsi::Transform* camera, Frustum* frustum);
     };
 }
 
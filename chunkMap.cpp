@@ -0,0 +1,85 @@
+#include "chunkMap.h"
+#include "chunk.h"
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <vector>
+#include <cstdint>
+
+using namespace Igsi;
+
+namespace Voxels {
+    // splitmix64 finalizer -- packed ids of nearby chunks only differ in a few bits, so they need a proper mix before masking
+    static std::uint64_t hashId(ChunkId id) {
+        id ^= id >> 30;
+        id *= 0xbf58476d1ce4e5b9ULL;
+        id ^= id >> 27;
+        id *= 0x94d049bb133111ebULL;
+        id ^= id >> 31;
+        return id;
+    }
+
+    ChunkMap::ChunkMap() {
+        slots.assign(64, Slot{ 0, nullptr });
+        count = 0;
+    }
+    ChunkMap::~ChunkMap() {
+        for (int i = 0; i < slots.size(); i++) delete slots[i].chunk;
+    }
+
+    int ChunkMap::findSlot(ChunkId id) {
+        int mask = slots.size() - 1;
+        int i = hashId(id) & mask;
+        while (slots[i].chunk != nullptr && slots[i].id != id) i = (i + 1) & mask;
+        return i;
+    }
+    void ChunkMap::grow() {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.assign(old.size() * 2, Slot{ 0, nullptr });
+        for (int i = 0; i < old.size(); i++) {
+            if (old[i].chunk != nullptr) slots[findSlot(old[i].id)] = old[i];
+        }
+    }
+
+    Chunk* ChunkMap::find(ChunkId id) {
+        return slots[findSlot(id)].chunk;
+    }
+    Chunk* ChunkMap::insert(ChunkId id, vec3 coords) {
+        int i = findSlot(id);
+        if (slots[i].chunk != nullptr) return slots[i].chunk;
+
+        // Keep the load factor at or below 1/2 so probe sequences stay short
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+            i = findSlot(id);
+        }
+        slots[i].id = id;
+        slots[i].chunk = new Chunk(coords);
+        count++;
+        return slots[i].chunk;
+    }
+    Chunk* ChunkMap::remove(ChunkId id) {
+        int i = findSlot(id);
+        Chunk* chunk = slots[i].chunk;
+        if (chunk == nullptr) return nullptr;
+
+        slots[i].chunk = nullptr;
+        count--;
+
+        // Backward shift deletion instead of tombstones: pull later entries of the probe run back into the hole,
+        // unless that would move them before their own home slot
+        int mask = slots.size() - 1;
+        int hole = i;
+        for (int j = (i + 1) & mask; slots[j].chunk != nullptr; j = (j + 1) & mask) {
+            int home = hashId(slots[j].id) & mask;
+            // Is home cyclically outside (hole, j]? Then the entry can move to the hole
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                slots[j].chunk = nullptr;
+                hole = j;
+            }
+        }
+        return chunk;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef VOXELS_CHUNKMAP_H
+#define VOXELS_CHUNKMAP_H
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include "chunkStorage.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace Voxels {
+    class Chunk;
+
+    // Open-addressing hash table from ChunkId to Chunk*, using linear probing
+    // The table itself only stores (id, pointer) pairs so probing stays within a few cache lines,
+    // while the chunks are heap allocated so their addresses never change when the table grows
+    // Never runs out of room
+    class ChunkMap : public ChunkStorage {
+    private:
+        struct Slot {
+            ChunkId id;
+            Chunk* chunk; // nullptr means the slot is empty
+        };
+        std::vector<Slot> slots; // Size is always a power of two
+        int count;
+
+        int findSlot(ChunkId id); // Index of the slot holding id, or of the empty slot where it would go
+        void grow();
+    public:
+        ChunkMap();
+        ~ChunkMap();
+        ChunkMap(const ChunkMap&) = delete;
+        ChunkMap& operator = (const ChunkMap&) = delete;
+
+        Chunk* find(ChunkId id);
+        Chunk* insert(ChunkId id, Igsi::vec3 coords);
+        Chunk* remove(ChunkId id);
+        Chunk* occupant(ChunkId id) { return nullptr; }
+
+        int size() { return count; }
+        int capacity() { return slots.size(); }
+        Chunk* slot(int i) { return slots[i].chunk; }
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "chunkMesher.h"
+#include "chunk.h"
+
+#include <glad/gl.h>
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <vector>
+#include <cstring>
+
+using namespace Igsi;
+
+namespace Voxels {
+    // A uniform solid chunk can only have faces on its borders, and only where the neighbor's border is air
+    // If all 6 face neighbors are uniform solid too, there is nothing to mesh at all
+    bool ChunkMesher::isBuried(Chunk &chunk) {
+        const int offsets[6][3] = { { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+        for (int i = 0; i < 6; i++) {
+            Chunk* neighbor = chunk.neighbors[Chunk::neighborIndex(offsets[i][0], offsets[i][1], offsets[i][2])];
+            if (neighbor == nullptr) return false; // Missing chunks count as air
+            if (!neighbor->isUniform() || neighbor->getUniformBlock() == 0) return false;
+        }
+        return true;
+    }
+
+    // Copies the chunk plus a one voxel border from its neighbors into paddedScratch, (w + 2) * (h + 2) * (d + 2) voxels in x, then y, then z order
+    // Each chunk is read under its own voxel lock, so the mesh is built from a consistent copy even if chunks are edited meanwhile
+    void ChunkMesher::snapshotPadded(Chunk &chunk) {
+        int w = chunkDims.x, h = chunkDims.y, d = chunkDims.z;
+        int strideY = w + 2;
+        int strideZ = (w + 2) * (h + 2);
+        paddedScratch.resize(strideZ * (d + 2));
+
+        // The chunk itself, decoded in one go and copied in row by row
+        voxelScratch.resize(NUM_VOXELS);
+        chunk.getVoxels(voxelScratch.data());
+        for (int z = 0; z < d; z++) {
+            for (int y = 0; y < h; y++) {
+                memcpy(&paddedScratch[1 + (y + 1) * strideY + (z + 1) * strideZ], &voxelScratch[y * w + z * w * h], w);
+            }
+        }
+
+        // The border, one box per neighbor (6 faces, 12 edges, 8 corners)
+        const int size[3] = { w, h, d };
+        for (int nz = -1; nz <= 1; nz++) {
+            for (int ny = -1; ny <= 1; ny++) {
+                for (int nx = -1; nx <= 1; nx++) {
+                    if (nx == 0 && ny == 0 && nz == 0) continue;
+                    int n[3] = { nx, ny, nz };
+                    int from[3], to[3], dest[3];
+                    for (int a = 0; a < 3; a++) {
+                        // -1: last layer of the neighbor goes to padded 0, 0: the whole range goes to padded 1~size, 1: first layer goes to padded size + 1
+                        from[a] = n[a] < 0 ? size[a] - 1 : 0;
+                        to[a] = n[a] == 0 ? size[a] : from[a] + 1;
+                        dest[a] = n[a] < 0 ? 0 : (n[a] == 0 ? 1 : size[a] + 1);
+                    }
+                    char* out = &paddedScratch[dest[0] + dest[1] * strideY + dest[2] * strideZ];
+
+                    Chunk* neighbor = chunk.neighbors[Chunk::neighborIndex(nx, ny, nz)];
+                    if (neighbor != nullptr) {
+                        neighbor->copyVoxels(from[0], from[1], from[2], to[0], to[1], to[2], out, strideY, strideZ);
+                    }
+                    else { // Missing chunks count as air
+                        for (int z = 0; z < to[2] - from[2]; z++) {
+                            for (int y = 0; y < to[1] - from[1]; y++) {
+                                memset(out + y * strideY + z * strideZ, 0, to[0] - from[0]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Fills N with the 3x3x3 neighborhood of padded index p
+    void ChunkMesher::getNeighborhood(int p, char N[3][3][3]) {
+        int strideY = chunkDims.x + 2;
+        int strideZ = (chunkDims.x + 2) * (chunkDims.y + 2);
+        int q = p - 1 - strideY - strideZ; // Padded index of N[0][0][0]
+        for (int nz = 0; nz < 3; nz++) {
+            for (int ny = 0; ny < 3; ny++) {
+                for (int nx = 0; nx < 3; nx++) {
+                    N[nx][ny][nz] = paddedScratch[q + nx + ny * strideY + nz * strideZ];
+                }
+            }
+        }
+    }
+
+    void ChunkMesher::addFace(Chunk &chunk, int faceId, char blockType, vec3 local, char N[3][3][3]) {
+        if (layout == FACES) chunk.addFaceRecord(faceBuckets[faceId], faceId, blockType, local, N);
+        else chunk.addCubeFace(faceBuckets[faceId], faceId, blockType, local, N, layout == QUADS);
+    }
+
+    // One quad per visible voxel face
+    void ChunkMesher::meshPerFace(Chunk &chunk) {
+        int w = chunkDims.x, h = chunkDims.y, d = chunkDims.z;
+        int strideY = w + 2;
+        int strideZ = (w + 2) * (h + 2);
+        char N[3][3][3];
+
+        for (int z = 0; z < d; z++) {
+            for (int y = 0; y < h; y++) {
+                int p = 1 + (y + 1) * strideY + (z + 1) * strideZ; // Padded index of (0, y, z)
+                for (int x = 0; x < w; x++, p++) {
+                    char currentBlock = paddedScratch[p];
+                    if (currentBlock == 0) continue;
+
+                    getNeighborhood(p, N);
+
+                    vec3 local = vec3(x, y, z);
+                    if (!N[1][1][2]) addFace(chunk, 0, currentBlock, local, N); // N
+                    if (!N[1][1][0]) addFace(chunk, 1, currentBlock, local, N); // S
+                    if (!N[2][1][1]) addFace(chunk, 2, currentBlock, local, N); // E
+                    if (!N[0][1][1]) addFace(chunk, 3, currentBlock, local, N); // W
+                    if (!N[1][2][1]) addFace(chunk, 4, currentBlock, local, N); // T
+                    if (!N[1][0][1]) addFace(chunk, 5, currentBlock, local, N); // B
+                }
+            }
+        }
+    }
+
+    // Merges coplanar faces with the same atlas texture and the same AO corners into larger quads
+    // The texture and AO repeat once per block (see Chunk::addQuad), so the result looks exactly like meshPerFace
+    // For each face direction and each slice along its normal, we build a mask of the visible faces,
+    // then repeatedly take the first face left, grow it along u as far as the faces match, then along v as far as whole rows match
+    void ChunkMesher::meshGreedy(Chunk &chunk) {
+        int size[3] = { (int)chunkDims.x, (int)chunkDims.y, (int)chunkDims.z };
+        int stride[3] = { 1, size[0] + 2, (size[0] + 2) * (size[1] + 2) };
+
+        // In faceId order N, S, E, W, T, B
+        const int normalAxis[6] = { 2, 2, 0, 0, 1, 1 };
+        const int normalSign[6] = { 1, -1, 1, -1, 1, -1 };
+        char N[3][3][3];
+
+        for (int faceId = 0; faceId < 6; faceId++) {
+            int n = normalAxis[faceId];
+            int u = uvAxes[faceId][0];
+            int v = uvAxes[faceId][1];
+            int facing = normalSign[faceId] * stride[n]; // Padded offset to the voxel the face looks at
+            greedyMask.resize(size[u] * size[v]);
+
+            for (int k = 0; k < size[n]; k++) {
+                // 0 where there is no face, otherwise 1 + (atlas index | AO << 8)
+                for (int j = 0; j < size[v]; j++) {
+                    for (int i = 0; i < size[u]; i++) {
+                        int c[3];
+                        c[n] = k, c[u] = i, c[v] = j;
+                        int p = (c[0] + 1) * stride[0] + (c[1] + 1) * stride[1] + (c[2] + 1) * stride[2];
+
+                        int key = 0;
+                        char block = paddedScratch[p];
+                        if (block != 0 && paddedScratch[p + facing] == 0) {
+                            getNeighborhood(p, N);
+                            key = 1 + (atlasLUT[block][faceId] | (Chunk::getFaceAO(faceId, N) << 8));
+                        }
+                        greedyMask[i + j * size[u]] = key;
+                    }
+                }
+
+                for (int j = 0; j < size[v]; j++) {
+                    for (int i = 0; i < size[u]; ) {
+                        int key = greedyMask[i + j * size[u]];
+                        if (key == 0) {
+                            i++;
+                            continue;
+                        }
+
+                        int width = 1;
+                        while (i + width < size[u] && greedyMask[i + width + j * size[u]] == key) width++;
+
+                        int height = 1;
+                        for (; j + height < size[v]; height++) {
+                            bool rowMatches = true;
+                            for (int x = 0; x < width && rowMatches; x++) rowMatches = greedyMask[i + x + (j + height) * size[u]] == key;
+                            if (!rowMatches) break;
+                        }
+
+                        for (int y = 0; y < height; y++) {
+                            for (int x = 0; x < width; x++) greedyMask[i + x + (j + y) * size[u]] = 0;
+                        }
+
+                        vec3 origin, extent = vec3(1.0);
+                        origin[n] = k, origin[u] = i, origin[v] = j;
+                        extent[u] = width, extent[v] = height;
+                        chunk.addQuad(faceBuckets[faceId], faceId, (key - 1) & 0xff, (key - 1) >> 8, origin, extent, layout == QUADS);
+
+                        i += width;
+                    }
+                }
+            }
+        }
+    }
+
+    void ChunkMesher::build(Chunk &chunk, MeshLayout layout, bool greedy) {
+        this->layout = layout;
+        for (int f = 0; f < 6; f++) faceBuckets[f].clear();
+
+        // Otherwise there are no faces, and the empty mesh releases the chunk's geometry memory once published
+        if (!chunk.isUniform() || (chunk.getUniformBlock() != 0 && !isBuried(chunk))) {
+            snapshotPadded(chunk);
+
+            // Everything below only touches paddedScratch, so there are no bounds checks and no other chunks involved
+            // A face record has no room for a size, so the FACES layout can't hold merged quads
+            if (greedy && layout != FACES) meshGreedy(chunk);
+            else meshPerFace(chunk);
+        }
+
+        // Buckets go one after another in faceId order, so drawChunks can draw any run of them with a single call
+        int wordsPerFace = layout == FACES ? 1 : Chunk::STRIDE * (layout == QUADS ? 4 : 6);
+        geometry.clear();
+        for (int f = 0; f < 6; f++) {
+            faceCounts[f] = faceBuckets[f].size() / wordsPerFace;
+            geometry.insert(geometry.end(), faceBuckets[f].begin(), faceBuckets[f].end());
+        }
+    }
+}
\ No newline at end of file
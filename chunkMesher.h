@@ -0,0 +1,38 @@
+#ifndef VOXELS_CHUNKMESHER_H
+#define VOXELS_CHUNKMESHER_H
+
+#include <glad/gl.h>
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include "chunk.h"
+
+#include <vector>
+
+namespace Voxels {
+    // Builds the mesh of one chunk at a time into its own scratch buffers
+    // Each mesh worker has its own ChunkMesher, so builds on different threads share nothing but the chunks they read
+    class ChunkMesher {
+    private:
+        std::vector<char> voxelScratch; // Decoded voxels of the chunk being meshed, reused between builds
+        std::vector<char> paddedScratch; // The chunk being meshed plus a one voxel border from its neighbors, see snapshotPadded
+        std::vector<GLuint> faceBuckets[6]; // Faces being built, one bucket per faceId
+        std::vector<int> greedyMask; // Faces of the slice being merged by meshGreedy
+
+        bool isBuried(Chunk &chunk);
+        void snapshotPadded(Chunk &chunk);
+        void getNeighborhood(int p, char N[3][3][3]);
+        void addFace(Chunk &chunk, int faceId, char blockType, Igsi::vec3 local, char N[3][3][3]); // In layout
+        void meshPerFace(Chunk &chunk);
+        void meshGreedy(Chunk &chunk);
+    public:
+        // Result of the last build
+        MeshLayout layout;
+        std::vector<GLuint> geometry; // The buckets joined together in faceId order
+        int faceCounts[6]; // Number of faces in each bucket
+
+        void build(Chunk &chunk, MeshLayout layout, bool greedy);
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef VOXELS_CHUNKSTORAGE_H
+#define VOXELS_CHUNKSTORAGE_H
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <cstdint>
+
+namespace Voxels {
+    class Chunk;
+
+    // Chunk coordinates packed into 21 bits per axis (x, then y, then z), so every chunk within +/- 1 million chunks of the origin gets an exact, unique id
+    typedef std::uint64_t ChunkId;
+
+    // Where ChunkManager keeps its chunks, either a ChunkMap (any set of chunks) or a ChunkGrid (a fixed box of them around one viewer)
+    // Owns the chunks. Not thread safe on its own, ChunkManager guards it
+    class ChunkStorage {
+    public:
+        virtual ~ChunkStorage() {}
+
+        virtual Chunk* find(ChunkId id) = 0; // nullptr if there is no such chunk
+        virtual Chunk* insert(ChunkId id, Igsi::vec3 coords) = 0; // Returns the existing chunk if there already is one, nullptr if there is no room for it
+        virtual Chunk* remove(ChunkId id) = 0; // Hands the chunk back instead of deleting it. nullptr if there was none
+        virtual Chunk* occupant(ChunkId id) = 0; // The chunk that has to be removed before id can be inserted, nullptr if nothing is in the way
+
+        virtual int size() = 0;
+
+        // For iterating over every chunk: slot(i) for i in [0, capacity()) is nullptr for empty slots
+        virtual int capacity() = 0;
+        virtual Chunk* slot(int i) = 0;
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "chunkStreamer.h"
+#include "chunkManager.h"
+#include "chunkUpdater.h"
+#include "chunk.h"
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <shared_mutex>
+
+using namespace Igsi;
+
+namespace Voxels {
+    ChunkStreamer::ChunkStreamer(ChunkManager* chunkManager, ChunkUpdater* chunkUpdater, int loadRadius, int unloadRadius, int minY, int maxY) {
+        this->chunkManager = chunkManager;
+        this->chunkUpdater = chunkUpdater;
+        this->loadRadius = loadRadius;
+        this->unloadRadius = std::max(loadRadius, unloadRadius);
+        this->minY = minY;
+        this->maxY = maxY;
+
+        maxLoads = 32;
+        maxUnloads = 32;
+        maxLoadChecks = 512;
+        maxUnloadChecks = 256;
+
+        loadCursor = 0;
+        unloadCursor = 0;
+        hasCenter = false;
+
+        for (int y = minY; y <= maxY; y++) {
+            for (int z = -loadRadius; z <= loadRadius; z++) {
+                for (int x = -loadRadius; x <= loadRadius; x++) loadOffsets.push_back(vec3(x, y, z));
+            }
+        }
+        // y is absolute, so only the horizontal distance counts. stable_sort keeps the order deterministic
+        std::stable_sort(loadOffsets.begin(), loadOffsets.end(), [](vec3 a, vec3 b) {
+            return a.x * a.x + a.z * a.z < b.x * b.x + b.z * b.z;
+        });
+    }
+
+    void ChunkStreamer::update(vec3 cameraPosition) {
+        vec3 coords = ChunkManager::getChunkCoords(floor(cameraPosition));
+        if (!hasCenter || coords.x != center.x || coords.z != center.z) {
+            hasCenter = true;
+            center = vec3(coords.x, 0.0, coords.z);
+            loadCursor = 0; // Start over from the nearest offset, most of them are already loaded and are skipped quickly
+        }
+
+        // Load
+        int loads = 0;
+        int unloads = 0;
+        for (int checks = 0; checks < maxLoadChecks && loads < maxLoads && loadCursor < loadOffsets.size(); checks++) {
+            vec3 chunkCoords = center + loadOffsets[loadCursor];
+            ChunkId id = ChunkManager::coordsToId(chunkCoords);
+            if (chunkManager->hasChunk(id)) {
+                loadCursor++;
+                continue;
+            }
+
+            // With a ChunkGrid, the slot may still hold the chunk from the far side of the grid, which is out of range by now, so recycle it
+            Chunk* occupant = chunkManager->findOccupant(id);
+            if (occupant != nullptr) {
+                if (unloads == maxUnloads) break; // Try again next frame
+                chunkUpdater->unloadChunk(ChunkManager::coordsToId(occupant->coords));
+                unloads++;
+            }
+            loadCursor++;
+            if (chunkManager->addChunk(chunkCoords) == nullptr) continue; // The grid is too small for loadRadius
+            chunkUpdater->fillQueue.push(id);
+            loads++;
+        }
+
+        // Unload, by sweeping over ChunkManager::chunks a few slots per frame
+        // This also catches chunks that weren't loaded by us, like ones created by edits
+        toUnload.clear();
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(chunkManager->chunksMutex);
+            ChunkStorage &chunks = *chunkManager->chunks;
+            int numChecks = std::min(maxUnloadChecks, chunks.capacity());
+            for (int checks = 0; checks < numChecks && unloads + toUnload.size() < maxUnloads; checks++) {
+                unloadCursor = (unloadCursor + 1) % chunks.capacity(); // The table may have grown since the last frame
+                Chunk* chunk = chunks.slot(unloadCursor);
+                if (chunk == nullptr) continue;
+
+                float distance = std::fmax(std::fabs(chunk->coords.x - center.x), std::fabs(chunk->coords.z - center.z));
+                if (distance > unloadRadius) toUnload.push_back(ChunkManager::coordsToId(chunk->coords));
+            }
+        }
+        // Deleting shifts entries around in the table, so it has to wait until after the sweep
+        for (int i = 0; i < toUnload.size(); i++) chunkUpdater->unloadChunk(toUnload[i]);
+
+        chunkUpdater->freeRetiredChunks();
+    }
+}
\ No newline at end of file
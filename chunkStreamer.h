@@ -0,0 +1,48 @@
+#ifndef VOXELS_CHUNKSTREAMER_H
+#define VOXELS_CHUNKSTREAMER_H
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include "chunkStorage.h"
+
+#include <vector>
+
+namespace Voxels {
+    class ChunkManager;
+    class ChunkUpdater;
+
+    // Loads the chunks around the camera and unloads the ones it left behind
+    // Distances are in chunks and horizontal only (max of |dx| and |dz|, so the loaded area is a square like before), terrain spans minY to maxY
+    // unloadRadius is larger than loadRadius, so going back and forth over a chunk boundary doesn't load and unload the same chunks over and over
+    // Everything is spread over frames with fixed budgets, so crossing into another chunk never does more than one frame's worth of work
+    // Call update from the thread with the GL context, since unloading frees meshes
+    class ChunkStreamer {
+    private:
+        std::vector<Igsi::vec3> loadOffsets; // Every offset within loadRadius, nearest first
+        int loadCursor; // How far through loadOffsets we got since the camera last changed chunk
+        int unloadCursor; // Next slot of ChunkManager::chunks to check
+        std::vector<ChunkId> toUnload; // Scratch for update
+
+        bool hasCenter;
+        Igsi::vec3 center; // Chunk the camera is in
+    public:
+        ChunkManager* chunkManager;
+        ChunkUpdater* chunkUpdater;
+
+        int loadRadius;
+        int unloadRadius;
+        int minY, maxY;
+
+        // Per frame budgets
+        int maxLoads; // Chunks added
+        int maxUnloads; // Chunks deleted
+        int maxLoadChecks; // Offsets looked at, whether or not they were already loaded
+        int maxUnloadChecks; // ChunkManager::chunks slots looked at
+
+        ChunkStreamer(ChunkManager* chunkManager, ChunkUpdater* chunkUpdater, int loadRadius, int unloadRadius, int minY, int maxY);
+
+        void update(Igsi::vec3 cameraPosition);
+    };
+}
+
+#endif
\ No newline at end of file
@@ -2,107 +2,262 @@
 #include "chunkManager.h"
 #include "chunk.h"
 #include "gen.h"
+#include "vertexArena.h"
+#include "frustum.h"
 
 #include <glad/gl.h>
 
 #include "dependencies/igsi/core/vec3.h"
+#include "dependencies/igsi/core/vec4.h"
 #include "dependencies/igsi/core/mat4.h"
 #include "dependencies/igsi/core/helpers.h"
 #include "dependencies/igsi/core/transform.h"
 
 #include <iostream>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cmath>
 #include <map>
 #include <algorithm>
+#include <cstring>
+#include <shared_mutex>
+#include <chrono>
 
 using namespace Igsi;
 
 namespace Voxels {
+    // Orders the heap so the lowest priority is at the front
+    template <typename Entry>
+    static bool popsLater(const Entry &a, const Entry &b) {
+        if (a.priority != b.priority) return a.priority > b.priority;
+        return a.order > b.order;
+    }
+
     template <typename T>
     void SafeUniqueQueue<T>::push(T elem) {
         std::lock_guard<std::mutex> lock(m);
         // Without checks -- Max 19 elements at a time
         // With find -- Max 4
         // With back -- Around 5, Max 11
-        if (std::find(q.begin(), q.end(), elem) == q.end()) {
-        // if (q.empty() || q.back() != elem) {
-            q.push_back(elem);
+        if (queued.emplace(elem, numPushed).second) {
+            heap.push_back(Entry{ getPriority(elem), numPushed++, elem });
+            std::push_heap(heap.begin(), heap.end(), popsLater<Entry>);
+            cv.notify_one();
+        }
+    }
+    template <typename T>
+    bool SafeUniqueQueue<T>::isLive(const Entry &entry) {
+        auto it = queued.find(entry.elem);
+        return it != queued.end() && it->second == entry.order;
+    }
+    template <typename T>
+    void SafeUniqueQueue<T>::compactLocked() {
+        heap.erase(std::remove_if(heap.begin(), heap.end(), [this](const Entry &entry) { return !isLive(entry); }), heap.end());
+        if (stale) {
+            for (int i = 0; i < heap.size(); i++) heap[i].priority = getPriority(heap[i].elem);
+            stale = false;
+        }
+        std::make_heap(heap.begin(), heap.end(), popsLater<Entry>);
+    }
+    template <typename T>
+    bool SafeUniqueQueue<T>::popLocked(T &elem) {
+        if (stale) compactLocked();
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), popsLater<Entry>);
+            Entry entry = heap.back();
+            heap.pop_back();
+            if (!isLive(entry)) continue; // Cancelled
+
+            elem = entry.elem;
+            queued.erase(elem);
+            return true;
         }
+        return false;
     }
     template <typename T>
     bool SafeUniqueQueue<T>::pop(T &elem) {
-        if (q.empty()) return false;
+        // Has to check for elements under the lock too, otherwise two consumers can both see the last element and both pop it
         std::lock_guard<std::mutex> lock(m);
-        elem = q.front();
-        q.pop_front();
+        return popLocked(elem);
+    }
+    template <typename T>
+    bool SafeUniqueQueue<T>::waitPop(T &elem) {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return closed || !queued.empty(); }); // Cancelled entries don't count
+        if (closed) return false;
+        return popLocked(elem); // Always finds one, queued isn't empty
+    }
+    template <typename T>
+    void SafeUniqueQueue<T>::reprioritize() {
+        std::lock_guard<std::mutex> lock(m);
+        stale = true;
+    }
+    template <typename T>
+    bool SafeUniqueQueue<T>::cancel(T elem) {
+        std::lock_guard<std::mutex> lock(m);
+        if (queued.erase(elem) == 0) return false;
+        // Don't let cancelled entries pile up when e.g. flying fast unloads whole rows of chunks that never got filled
+        if (heap.size() > queued.size() * 2 + 64) compactLocked();
         return true;
     }
 
+    template <typename T>
+    int SafeUniqueQueue<T>::size() {
+        std::lock_guard<std::mutex> lock(m);
+        return queued.size();
+    }
 
-    ChunkUpdater::ChunkUpdater(ChunkManager* chunkManager, ChunkGenerator* chunkGenerator) {
+    template <typename T>
+    void SafeUniqueQueue<T>::close() {
+        std::lock_guard<std::mutex> lock(m);
+        closed = true;
+        cv.notify_all();
+    }
+
+    template <typename T>
+    MPMCQueue<T>::MPMCQueue(std::size_t capacity) : cells(capacity) {
+        mask = capacity - 1;
+        for (std::size_t i = 0; i < capacity; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+    template <typename T>
+    bool MPMCQueue<T>::push(T elem) {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+            if (diff == 0) { // Free for this lap, try to claim it
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = elem;
+                    cell.sequence.store(pos + 1, std::memory_order_release); // Now readable
+                    return true;
+                }
+                // Otherwise pos was reloaded by compare_exchange_weak
+            }
+            else if (diff < 0) return false; // Still holds an element from the previous lap, so the queue is full
+            else pos = enqueuePos.load(std::memory_order_relaxed); // Another producer got here first
+        }
+    }
+    template <typename T>
+    bool MPMCQueue<T>::pop(T &elem) {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+            if (diff == 0) { // Written for this lap, try to claim it
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    elem = cell.data;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release); // Free for the next lap
+                    return true;
+                }
+            }
+            else if (diff < 0) return false; // Not written yet, so the queue is empty
+            else pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Defined here rather than in the header, so it has to be instantiated explicitly for the other files that use the queues
+    template class SafeUniqueQueue<ChunkId>;
+    template class MPMCQueue<ChunkId>;
+
+
+    ChunkUpdater::ChunkUpdater(ChunkManager* chunkManager, ChunkGenerator* chunkGenerator, int numFillWorkers, int numMeshWorkers)
+        : meshers(numMeshWorkers), cameraFrustum(1.0, 1.0, 0.1, 1000.0), mapQueue(1 << 16), numFillWorkers(numFillWorkers), numMeshWorkers(numMeshWorkers) {
         this->chunkManager = chunkManager;
         this->chunkGenerator = chunkGenerator;
+        hasCamera = false;
+
+        fillQueue.priorityOf = [this](ChunkId id) { return chunkPriority(id); };
+        populateQueue.priorityOf = fillQueue.priorityOf;
+        buildQueue.priorityOf = fillQueue.priorityOf;
+        uploadQueue.priorityOf = fillQueue.priorityOf;
+        uploadBudgetBytes = 4 << 20;
+        uploadBudgetMs = 2.0;
+        greedyMeshing = false;
+        meshLayout = TRIANGLES;
+        cpuMeshBytes = 0;
     }
 
     // Why is this here instead of inside Chunk? Because it requires access to global chunk data
-    void ChunkUpdater::updateGeometry(Chunk &chunk) {
-        chunk.geometryData.clear();
-
-        int tmpDrawCount = 0;
-        // We still need tmpDrawCount because while we are still in the middle of incrementing chunk.drawCount,
-        // the existing chunk geometry is being drawn with incomplete draw count
-        // So we have to update it once at the end
-
-        char N[3][3][3];
-
-        for (int i = 0; i < chunk.data.size(); i++) {
-            char currentBlock = chunk.data.at(i);
-            if (currentBlock == 0) continue;
-
-            vec3 local = vec3(
-                std::fmod(i, chunkDims.x),
-                std::fmod(std::floor(i / chunkDims.x), chunkDims.y),
-                std::floor(i / (chunkDims.x * chunkDims.y))
-            );
-            vec3 voxel = chunk.coords * chunkDims + local;
-
-            vec3 q = local - 1.0;
-            for (int nz = 0; nz < 3; nz++) {
-                for (int ny = 0; ny < 3; ny++) {
-                    for (int nx = 0; nx < 3; nx++) {
-                        vec3 r = q + vec3(nx, ny, nz);
-                        if (r.x < 0 || r.y < 0 || r.z < 0 || r.x > 15 || r.y > 15 || r.z > 15) {
-                            vec3 c = ChunkManager::getChunkCoords(r) + chunk.coords;
-                            vec3 l = ChunkManager::getLocalCoords(r);
-                            float id = ChunkManager::coordsToId(c);
-                            N[nx][ny][nz] = chunkManager->hasChunk(id) ? chunkManager->getChunk(id).getVoxel(l) : 0;
-                            // if (hasChunk(id)) {
-                            //     N[nx][ny][nz] = getChunk(id).getVoxel(l);
-                            // }
-                            // else {
-                            //     N[nx][ny][nz] = (
-                            //         (r.x < 0 || r.z < 0 || r.x > 15 || r.z > 15)
-                            //         && r.y >= 0
-                            //         && r.y <= 15
-                            //     ) ? 1 : 0;
-                            // }
-                        }
-                        else {
-                            N[nx][ny][nz] = chunk.getVoxel(r);
-                        }
-                    }
-                }
-            }
+    void ChunkUpdater::updateGeometry(Chunk &chunk, int worker) {
+        // The mesh is built into the worker's own mesher and only copied out once complete, see publishGeometry
+        // meshLayout is read once so the whole mesh has the same layout even if it gets switched mid-build
+        ChunkMesher &mesher = meshers[worker];
+        mesher.build(chunk, (MeshLayout)meshLayout.load(), greedyMeshing);
+        publishGeometry(chunk, mesher);
+    }
+    void ChunkUpdater::publishGeometry(Chunk &chunk, ChunkMesher &mesher) {
+        ChunkMesh* mesh = chunk.spareMesh.exchange(nullptr);
+        if (mesh == nullptr) mesh = new ChunkMesh();
+        long long oldCapacity = mesh->data.capacity();
 
-            if (!N[1][1][2]) tmpDrawCount += chunk.addCubeFace(0, currentBlock, local, N); // N
-            if (!N[1][1][0]) tmpDrawCount += chunk.addCubeFace(1, currentBlock, local, N); // S
-            if (!N[2][1][1]) tmpDrawCount += chunk.addCubeFace(2, currentBlock, local, N); // E
-            if (!N[0][1][1]) tmpDrawCount += chunk.addCubeFace(3, currentBlock, local, N); // W
-            if (!N[1][2][1]) tmpDrawCount += chunk.addCubeFace(4, currentBlock, local, N); // T
-            if (!N[1][0][1]) tmpDrawCount += chunk.addCubeFace(5, currentBlock, local, N); // B
+        // When growing, assign() reallocates to exactly the new size, so meshes never hold worst-case capacity
+        // When shrinking it keeps the old allocation, so give it back once less than half is in use
+        mesh->data.assign(mesher.geometry.begin(), mesher.geometry.end());
+        mesh->layout = mesher.layout;
+        for (int f = 0; f < 6; f++) mesh->faces[f] = mesher.faceCounts[f];
+        if (mesh->data.capacity() > mesh->data.size() * 2) mesh->data.shrink_to_fit();
+        cpuMeshBytes += ((long long)mesh->data.capacity() - oldCapacity) * (long long)sizeof(GLuint);
+
+        // If the render thread hasn't taken the previous mesh yet, it never will, so it becomes the spare instead
+        ChunkMesh* replaced = chunk.pendingMesh.exchange(mesh);
+        if (replaced != nullptr) recycleMesh(chunk, replaced);
+    }
+    void ChunkUpdater::recycleMesh(Chunk &chunk, ChunkMesh* mesh) {
+        // Two meshes can end up here at once (a worker publishing and the render thread uploading), then one of them goes
+        ChunkMesh* dropped = chunk.spareMesh.exchange(mesh);
+        if (dropped == nullptr) return;
+        cpuMeshBytes -= (long long)dropped->data.capacity() * (long long)sizeof(GLuint);
+        delete dropped;
+    }
+
+    void ChunkUpdater::rebuildAllChunks() {
+        std::shared_lock<std::shared_timed_mutex> lock(chunkManager->chunksMutex);
+        for (int i = 0; i < chunkManager->chunks->capacity(); i++) {
+            Chunk* chunk = chunkManager->chunks->slot(i);
+            if (chunk != nullptr) buildQueue.push(ChunkManager::coordsToId(chunk->coords));
+        }
+    }
+
+    // Squared distance from the camera to the chunk's center, a quarter of that if the chunk is in view
+    // Works from the id alone, so the chunk doesn't have to be looked up (or even exist anymore)
+    float ChunkUpdater::chunkPriority(ChunkId id) {
+        std::lock_guard<std::mutex> lock(cameraMutex);
+        if (!hasCamera) return 0.0;
+
+        vec3 center = (ChunkManager::idToCoords(id) + 0.5) * chunkDims;
+        vec3 toChunk = center - cameraPosition;
+        float priority = dot(toChunk, toChunk);
+
+        float radius = length(vec3(0.5) * chunkDims);
+        vec4 viewCenter = cameraInverseWorldMatrix * vec4(center.x, center.y, center.z, 1.0);
+        if (cameraFrustum.intersectsSphere(vec3(viewCenter.x, viewCenter.y, viewCenter.z), radius)) priority *= 0.25; // i.e. as if half as far
+        return priority;
+    }
+    void ChunkUpdater::setCamera(Transform* camera, Frustum* frustum) {
+        vec3 position = camera->position;
+        vec3 direction = -camera->getWorldDirection();
+        {
+            std::lock_guard<std::mutex> lock(cameraMutex);
+            // Reordering is O(n) per queue, so don't do it for movement within a chunk or small turns (cos 15 degrees)
+            bool sameChunk = ChunkManager::getChunkCoords(floor(position)) == ChunkManager::getChunkCoords(floor(cameraPosition));
+            if (hasCamera && sameChunk && dot(direction, cameraDirection) > 0.966) return;
+
+            hasCamera = true;
+            cameraPosition = position;
+            cameraDirection = direction;
+            cameraInverseWorldMatrix = camera->inverseWorldMatrix;
+            cameraFrustum = *frustum;
         }
-        chunk.drawCount = tmpDrawCount;
+        fillQueue.reprioritize();
+        populateQueue.reprioritize();
+        buildQueue.reprioritize();
+        uploadQueue.reprioritize();
     }
 
     void ChunkUpdater::rebuildNeighborChunks(vec3 coords, vec3 local) {
@@ -113,128 +268,210 @@ namespace Voxels {
         float z = std::trunc(local.z / upperBound.z * 2.0 - 1);
 
         if (x != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(x, 0, 0));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(x, 0, 0));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
         if (y != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(0, y, 0));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(0, y, 0));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
         if (z != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(0, 0, z));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(0, 0, z));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
 
         // Although these neighbors are not necessarily touching the chunk, their AO is still affected
 
         if (x != 0 && y != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(x, y, 0));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(x, y, 0));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
         if (x != 0 && z != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(x, 0, z));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(x, 0, z));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
         if (y != 0 && z != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(0, y, z));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(0, y, z));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
 
         if (x != 0 && y != 0 && z != 0) {
-            float id = ChunkManager::coordsToId(coords + vec3(x, y, z));
+            ChunkId id = ChunkManager::coordsToId(coords + vec3(x, y, z));
             if (chunkManager->hasChunk(id)) buildQueue.push(id);
         }
     }
 
-    void ChunkUpdater::fillNext() {
-        if (!fillQueue.empty()) {
-            float nextId = fillQueue.front();
-            fillQueue.pop_front();
-            Chunk &chunk = chunkManager->getChunk(nextId);
-
-            chunkGenerator->fillTerrain(&chunk);
-            
-            for (int nz = -1; nz <= 1; nz++) {
-                for (int ny = -1; ny <= 1; ny++) {
-                    for (int nx = -1; nx <= 1; nx++) {
-                        if (nx == 0 && ny == 0 && nz == 0) continue;
-                        float id = ChunkManager::coordsToId(chunk.coords + vec3(nx, ny, nz));
-                        if (chunkManager->hasChunk(id)) {
-                            chunk.numNeighbors += 1;
-                            chunkManager->getChunk(id).numFilledNeighbors += 1;
-                        }
-                    }
-                }
-            }
-            populateQueue.push(nextId);
-        }
-        else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        }
-    }
-    void ChunkUpdater::populateNext() {
-        float nextId;
-        if (populateQueue.pop(nextId)) {
-            Chunk &chunk = chunkManager->getChunk(nextId);
-
-            if (chunk.numFilledNeighbors == chunk.numNeighbors) {
-                chunkGenerator->populateTerrain(&chunk, chunkManager);
-
-                for (int nz = -1; nz <= 1; nz++) {
-                    for (int ny = -1; ny <= 1; ny++) {
-                        for (int nx = -1; nx <= 1; nx++) {
-                            if (nx == 0 && ny == 0 && nz == 0) continue;
-                            float id = ChunkManager::coordsToId(chunk.coords + vec3(nx, ny, nz));
-                            if (chunkManager->hasChunk(id)) {
-                                chunkManager->getChunk(id).numPopulatedNeighbors += 1;
-                            }
-                        }
-                    }
-                }
-                buildQueue.push(nextId);
-            }
-            else {
-                populateQueue.push(nextId);
-            }
-        }
-        else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    void ChunkUpdater::unloadChunk(ChunkId id) {
+        readyToPopulate.clear();
+        readyToBuild.clear();
+        chunkManager->deleteChunk(id, readyToPopulate, readyToBuild);
+
+        // Only once the chunk is unlinked, since until then a worker finishing a neighbor can push it again
+        fillQueue.cancel(id);
+        populateQueue.cancel(id);
+        buildQueue.cancel(id);
+        uploadQueue.cancel(id);
+
+        for (int i = 0; i < readyToPopulate.size(); i++) populateQueue.push(readyToPopulate[i]);
+        for (int i = 0; i < readyToBuild.size(); i++) buildQueue.push(readyToBuild[i]);
+    }
+    void ChunkUpdater::freeRetiredChunks() {
+        cpuMeshBytes -= chunkManager->freeRetiredChunks();
+    }
+
+    // A chunk's populate waits on it and its neighbors being filled, and its build waits on them all being populated
+    // Chunk::populateDeps and Chunk::buildDeps count what is still outstanding (see ChunkManager::addChunk),
+    // so whoever finishes the last dependency schedules the chunk, exactly once
+
+    // Returns true if this took deps to 0, i.e. the chunk is now ready
+    // Counters already at 0 are left alone: the chunk stopped waiting before this dependency was linked to it, so it never counted it
+    static bool releaseDependency(std::atomic<int> &deps) {
+        int d = deps;
+        while (d > 0 && !deps.compare_exchange_weak(d, d - 1));
+        return d == 1;
+    }
+    // Releases the dependency on chunk of it and every neighbor, and pushes the ones that became ready onto queue
+    // Takes chunksMutex so that addChunk can't link in a new chunk halfway through
+    static void releaseNeighbors(ChunkManager* chunkManager, Chunk &chunk, ChunkState state, SafeUniqueQueue<ChunkId> &queue) {
+        std::shared_lock<std::shared_timed_mutex> lock(chunkManager->chunksMutex);
+        chunk.state = state;
+        for (int i = 0; i < 27; i++) { // Includes the chunk itself
+            Chunk* neighbor = chunk.neighbors[i];
+            if (neighbor == nullptr) continue;
+            std::atomic<int> &deps = state == FILLED ? neighbor->populateDeps : neighbor->buildDeps;
+            if (releaseDependency(deps)) queue.push(ChunkManager::coordsToId(neighbor->coords));
+            // A neighbor that stopped waiting before this chunk was linked may already be meshed as if there were nothing here,
+            // so its border needs redoing (e.g. the chunk nearer the camera when loading outwards)
+            else if (state == POPULATED && neighbor != &chunk && neighbor->buildDeps == 0) queue.push(ChunkManager::coordsToId(neighbor->coords));
         }
     }
 
-    void ChunkUpdater::buildNext() {
-        float nextId;
-        if (buildQueue.pop(nextId)) {
-            Chunk &chunk = chunkManager->getChunk(nextId);
+    // Keeps chunks that get deleted meanwhile from being freed until the end of the scope, see ChunkManager::beginJob
+    struct ChunkJob {
+        ChunkManager* chunkManager;
+        int epoch;
+        ChunkJob(ChunkManager* chunkManager) : chunkManager(chunkManager), epoch(chunkManager->beginJob()) {}
+        ~ChunkJob() { chunkManager->endJob(epoch); }
+    };
+
+    bool ChunkUpdater::fillNext() {
+        ChunkId nextId;
+        if (!fillQueue.waitPop(nextId)) return false;
+        ChunkJob job(chunkManager);
+        Chunk* chunk = chunkManager->findChunk(nextId);
+        if (chunk == nullptr) return true; // Unloaded just after it was popped
+        // The id may have been queued for a chunk that was unloaded since, and this is a new one at the same coordinates
+        if (chunk->state != EMPTY) return true;
+
+        chunkGenerator->fillTerrain(chunk);
+        releaseNeighbors(chunkManager, *chunk, FILLED, populateQueue);
+        return true;
+    }
+    bool ChunkUpdater::populateNext() {
+        ChunkId nextId;
+        if (!populateQueue.waitPop(nextId)) return false;
+        ChunkJob job(chunkManager);
+        Chunk* chunk = chunkManager->findChunk(nextId);
+        if (chunk == nullptr) return true;
+        if (chunk->state != FILLED || chunk->populateDeps > 0) return true; // Same as in fillNext, it gets queued again once ready
+
+        chunkGenerator->populateTerrain(chunk);
+        releaseNeighbors(chunkManager, *chunk, POPULATED, buildQueue);
+        return true;
+    }
+
+    bool ChunkUpdater::buildNext(int worker) {
+        ChunkId nextId;
+        if (!buildQueue.waitPop(nextId)) return false;
+        ChunkJob job(chunkManager);
+        Chunk* found = chunkManager->findChunk(nextId);
+        if (found == nullptr) return true;
+        Chunk &chunk = *found;
+
+        // e.g. an edit next to a chunk that is still generating. It gets built once ready anyway
+        if (chunk.buildDeps > 0) return true;
 
-            if (chunk.numPopulatedNeighbors == chunk.numNeighbors) {
-                updateGeometry(chunk);
-                mapQueue.push(nextId);
+        // If another worker is building this chunk right now, leave it to that worker to build it again once done,
+        // since its snapshot may predate whatever queued this build
+        // rebuildPending is set before trying to claim the chunk, so the other worker can't miss it (see the end of the loop)
+        chunk.rebuildPending = true;
+        if (chunk.building.exchange(true)) return true;
+
+        while (true) {
+            chunk.rebuildPending = false;
+            if (chunk.cancelled) {
+                chunk.building = false;
+                break;
             }
-            else {
-                buildQueue.push(nextId);
+            updateGeometry(chunk, worker);
+            chunk.state = MESHED;
+            if (!chunk.uploadQueued.exchange(true)) {
+                while (!mapQueue.push(nextId)) std::this_thread::yield(); // Only full if there are more than 65536 chunks waiting to be uploaded
             }
+            chunk.building = false;
+
+            // Stop unless a build was asked for meanwhile, and nobody else has claimed it since
+            if (!chunk.rebuildPending || chunk.building.exchange(true)) break;
         }
-        else {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        }
+        return true;
+    }
+    void ChunkUpdater::shutdown() {
+        fillQueue.close();
+        populateQueue.close();
+        buildQueue.close();
     }
-    void ChunkUpdater::mapNextAll() {
-        float nextId;
-        while (mapQueue.pop(nextId)) {
-            Chunk &chunk = chunkManager->getChunk(nextId);
-            // int numComponents = chunk.drawCount * Chunk::STRIDE;
+    void ChunkUpdater::uploadMeshes() {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        auto elapsedMs = [start]() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+        lastUpload = UploadStats();
+
+        ChunkId nextId;
+        while (mapQueue.pop(nextId)) uploadQueue.push(nextId);
 
-            glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
-            void* bufferPtr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-            memcpy(bufferPtr, chunk.geometryData.data(), chunk.geometryData.size() * sizeof(GLuint)); // cannot sizeof(vector) because sizeof is compile time but vector is runtime
-            glUnmapBuffer(GL_ARRAY_BUFFER);
+        // Whatever doesn't fit in this frame's budget stays in uploadQueue for the next one,
+        // so a burst of finished chunks gets spread over several frames instead of making one long one
+        while (lastUpload.chunks == 0 || (lastUpload.bytes < uploadBudgetBytes && elapsedMs() < uploadBudgetMs)) {
+            if (!uploadQueue.pop(nextId)) break;
 
-            // Do not do this because we already clear() at start of updategeo,
-            // it is inefficient to reserve all the time,
-            // and also it can cause crashes if you reserve all the time
-            // chunk.geometryData.clear();
-            // chunk.geometryData.shrink_to_fit();
+            // Chunks are only deleted on this thread, so no job is needed here
+            Chunk* found = chunkManager->findChunk(nextId);
+            if (found == nullptr) continue;
+            Chunk &chunk = *found;
+            chunk.uploadQueued = false; // Before taking the mesh, so a build published after this queues the chunk again
+            ChunkMesh* mesh = chunk.pendingMesh.exchange(nullptr);
+            if (mesh == nullptr) continue;
+
+            GLsizeiptr bytes = mesh->data.size() * sizeof(GLuint); // cannot sizeof(vector) because sizeof is compile time but vector is runtime
+            VertexArena &arena = chunkManager->vertexArena;
+
+            // Move to a new allocation with 50% headroom when the mesh outgrows the current one, so that small edits don't reallocate every time,
+            // and give the space back once the mesh uses less than a quarter of it (unless it is already a single block)
+            bool shrink = bytes < chunk.mesh.bytes / 4 && (bytes == 0 || chunk.mesh.bytes > VertexArena::BLOCK_BYTES);
+            if (bytes > chunk.mesh.bytes || shrink) {
+                arena.free(chunk.mesh);
+                if (bytes > 0 && !arena.allocate(bytes + bytes / 2, chunk.mesh)) {
+                    std::cerr << "Vertex arena is out of memory, chunk at " << chunk.coords << " will not be drawn" << std::endl;
+                }
+            }
+            // drawCount is only updated here, together with the upload, so drawChunks never draws past what was uploaded
+            // In vertices, or in indices for QUADS
+            int count = mesh->data.size() / Chunk::STRIDE;
+            if (mesh->layout == QUADS) count = count / 4 * 6;
+            else if (mesh->layout == FACES) count = mesh->data.size() * 6;
+            chunk.drawCount = chunk.mesh.page < 0 ? 0 : count;
+            chunk.drawLayout = mesh->layout;
+            chunk.state = UPLOADED;
+            for (int f = 0; f < 6; f++) chunk.drawFaces[f] = mesh->faces[f];
+            if (chunk.drawCount > 0) {
+                arena.upload(chunk.mesh, mesh->data.data(), bytes);
+                arena.setOrigin(chunk.mesh, chunk.coords * chunkDims); // The allocation may be new, or have belonged to another chunk
+            }
+            recycleMesh(chunk, mesh);
+            lastUpload.chunks++;
+            lastUpload.bytes += bytes;
         }
+        chunkManager->vertexArena.staging.endFrame();
+        lastUpload.ms = elapsedMs();
+        lastUpload.backlog = uploadQueue.size();
     }
 }
\ No newline at end of file
@@ -2,44 +2,166 @@
 #define VOXELS_CHUNKUPDATER_H
 
 #include "dependencies/igsi/core/vec3.h"
+#include "dependencies/igsi/core/mat4.h"
+#include "dependencies/igsi/core/transform.h"
+
+#include "chunk.h"
+#include "chunkStorage.h"
+#include "chunkMesher.h"
+#include "frustum.h"
+
+#include <glad/gl.h>
 
 #include <deque>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstddef>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 namespace Voxels {
     class Chunk;
     class ChunkGenerator;
     class ChunkManager;
 
+    // Queue that ignores pushes of elements already in it, and pops the element with the lowest priority first (FIFO among equal priorities)
+    // Membership is tracked in a hash map alongside the heap, so pushing stays O(log n) however long the queue gets
+    // Cancelling only drops the element from the map, its heap entry is left behind and skipped once it comes up.
+    // The map holds the push order of each element's live entry as a generation token, so a left over entry is never mistaken for a later push of the same element
     template <typename T>
     class SafeUniqueQueue {
     private:
+        struct Entry {
+            float priority;
+            long long order; // Push order, breaks ties
+            T elem;
+        };
         std::mutex m;
-        std::deque<T> q;
+        std::condition_variable cv;
+        std::vector<Entry> heap; // Also holds cancelled entries
+        std::unordered_map<T, long long> queued; // Element -> order of its live entry in heap
+        long long numPushed = 0;
+        bool stale = false;
+        bool closed = false;
+
+        float getPriority(T elem) { return priorityOf ? priorityOf(elem) : 0.0; }
+        bool isLive(const Entry &entry);
+        void compactLocked(); // Drops the cancelled entries and reheapifies, recomputing the priorities if stale
+        bool popLocked(T &elem); // m must be held. Returns false if there are only cancelled entries
     public:
+        std::function<float(T)> priorityOf; // Lower pops first. Plain FIFO if not set. Set before the queue is used
+
         void push(T elem);
-        bool pop(T &elem);
+        bool pop(T &elem); // Doesn't block
+        bool waitPop(T &elem); // Blocks until there is an element, returns false once the queue is closed
+        void close(); // Wakes every waiting thread, waitPop returns false from then on
+        void reprioritize(); // priorityOf would give different results now, so recompute them all (lazily, on the next pop)
+        bool cancel(T elem); // Returns false if it wasn't queued
+        int size();
+    };
+
+    // Bounded lock-free multi-producer multi-consumer FIFO (Dmitry Vyukov's design)
+    // Each cell carries a sequence number saying whether it is ready to be written or read for the current lap around the ring,
+    // so producers and consumers only contend on their own position counter
+    // Doesn't deduplicate, and push fails when full
+    template <typename T>
+    class MPMCQueue {
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            T data;
+        };
+        std::vector<Cell> cells;
+        std::size_t mask;
+        alignas(64) std::atomic<std::size_t> enqueuePos; // On separate cache lines so producers and consumers don't false share
+        alignas(64) std::atomic<std::size_t> dequeuePos;
+    public:
+        MPMCQueue(std::size_t capacity); // Must be a power of two
+        MPMCQueue(const MPMCQueue&) = delete;
+        MPMCQueue& operator = (const MPMCQueue&) = delete;
+
+        bool push(T elem); // Returns false if the queue is full
+        bool pop(T &elem); // Returns false if the queue is empty
+    };
+
+    // What the last ChunkUpdater::uploadMeshes did, for the debug overlay
+    struct UploadStats {
+        int chunks = 0;
+        long long bytes = 0;
+        double ms = 0.0; // CPU time, the GPU may still be copying afterwards
+        int backlog = 0; // Meshes left over for the next frames
     };
 
     class ChunkUpdater {
+    private:
+        std::vector<ChunkMesher> meshers; // One per mesh worker
+
+        // Snapshot of the camera for prioritizing, see setCamera
+        std::mutex cameraMutex;
+        bool hasCamera;
+        Igsi::vec3 cameraPosition;
+        Igsi::vec3 cameraDirection;
+        Igsi::mat4 cameraInverseWorldMatrix;
+        Frustum cameraFrustum;
+
+        std::vector<ChunkId> readyToPopulate, readyToBuild; // Scratch for unloadChunk
+
+        float chunkPriority(ChunkId id);
+
+        void publishGeometry(Chunk &chunk, ChunkMesher &mesher);
+        void recycleMesh(Chunk &chunk, ChunkMesh* mesh); // Makes mesh the chunk's spareMesh
     public:
         ChunkManager* chunkManager;
         ChunkGenerator* chunkGenerator;
 
-        std::deque<float> fillQueue;
-        SafeUniqueQueue<float> populateQueue;
-        SafeUniqueQueue<float> buildQueue;
-        SafeUniqueQueue<float> mapQueue;
+        SafeUniqueQueue<ChunkId> fillQueue;
+        SafeUniqueQueue<ChunkId> populateQueue;
+        SafeUniqueQueue<ChunkId> buildQueue;
+        // Many mesh workers push, the render thread pops every frame, so this one never takes a lock
+        // Chunk::uploadQueued keeps each chunk in it at most once
+        MPMCQueue<ChunkId> mapQueue;
+        // Render thread only, mapQueue gets moved into this every frame so uploads happen nearest first like everything else
+        SafeUniqueQueue<ChunkId> uploadQueue;
+
+        // Per frame limits on uploadMeshes, whichever is hit first. At least one mesh is uploaded per frame regardless
+        long long uploadBudgetBytes;
+        double uploadBudgetMs;
+        UploadStats lastUpload;
 
-        ChunkUpdater(ChunkManager* chunkManager, ChunkGenerator* chunkGenerator);
+        // Total bytes currently allocated for chunk meshes, for the debug overlay
+        // GPU usage is reported by ChunkManager::vertexArena
+        std::atomic<long long> cpuMeshBytes; // Chunk::meshBytes of every chunk
 
-        void updateGeometry(Chunk &chunk);
+        std::atomic<bool> greedyMeshing; // Merge faces into larger quads, takes effect as chunks get rebuilt
+        std::atomic<int> meshLayout; // MeshLayout of newly built meshes, also takes effect as chunks get rebuilt. Greedy meshing doesn't apply to FACES
+
+        const int numFillWorkers; // Threads calling fillNext
+        const int numMeshWorkers; // Threads calling buildNext, each passes its own worker index in [0, numMeshWorkers)
+
+        ChunkUpdater(ChunkManager* chunkManager, ChunkGenerator* chunkGenerator, int numFillWorkers = 1, int numMeshWorkers = 1);
+
+        void updateGeometry(Chunk &chunk, int worker);
+        void rebuildAllChunks(); // e.g. after switching greedyMeshing
         void rebuildNeighborChunks(Igsi::vec3 coords, Igsi::vec3 local);
+
+        // Deletes the chunk, cancels its queued work and schedules whichever neighbors were only waiting on it
+        // Jobs already running on it stop at the next Chunk::cancelled check, and its id may still be in mapQueue, which uploadMeshes skips
+        // Call these from the thread with the GL context, freeRetiredChunks every frame
+        void unloadChunk(ChunkId id);
+        void freeRetiredChunks();
+
+        // Work is done nearest to the camera first, with chunks in view counting as closer than they are
+        // Call every frame, the queues only get reordered once the camera moves to another chunk or turns far enough
+        void setCamera(Igsi::Transform* camera, Frustum* frustum);
         
-        void fillNext();
-        void populateNext();
-        void buildNext();
-        void mapNextAll();
+        // These block until there is work, and return false once shutdown() was called
+        bool fillNext();
+        bool populateNext();
+        bool buildNext(int worker);
+        void shutdown();
+        void uploadMeshes(); // Call every frame from the thread with the GL context
     };
 }
 
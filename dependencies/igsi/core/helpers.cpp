@@ -15,6 +15,9 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
 
 namespace Igsi {
     std::string readFile(std::string path) {
@@ -72,7 +75,7 @@ namespace Igsi {
             std::cerr << "Shader program linking failed: " << infoLog << std::endl;
         }
 
-        glUseProgram(shaderProgram);
+        useProgram(shaderProgram);
         return shaderProgram;
     }
     
@@ -154,36 +157,80 @@ namespace Igsi {
         glBufferSubData(GL_ARRAY_BUFFER, idx * 4 * sizeof(float), sizeof(float) * 4, vec);
     }
 
-    // GLuint currentShaderProgram = 0;
-    // void useProgram(GLint shaderProgram) {
-    //     if (currentShaderProgram != shaderProgram) {
-    //         glUseProgram(shaderProgram);
-    //         currentShaderProgram = shaderProgram;
-    //     }
-    // }
+    GLuint currentShaderProgram = 0;
+    void useProgram(GLuint shaderProgram) {
+        if (currentShaderProgram != shaderProgram) {
+            glUseProgram(shaderProgram);
+            currentShaderProgram = shaderProgram;
+        }
+    }
     GLuint getCurrentShaderProgram() {
-        GLint shaderProgram;
-        glGetIntegerv(GL_CURRENT_PROGRAM, &shaderProgram);
-        return shaderProgram;
+        return currentShaderProgram;
+    }
+
+    // std::less<> lets find() compare against the const char* directly, instead of building a std::string every call
+    std::unordered_map<GLuint, std::map<std::string, GLint, std::less<>>> uniformLocations;
+    GLint getUniformLocation(const GLchar* name, GLuint program) {
+        if (!program) program = getCurrentShaderProgram();
+        std::map<std::string, GLint, std::less<>> &locations = uniformLocations[program];
+        auto it = locations.find(name);
+        if (it != locations.end()) return it->second;
+
+        GLint location = glGetUniformLocation(program, name); // -1 gets cached too, setting it is silently ignored
+        locations.emplace(name, location);
+        return location;
     }
 
     void setUniformInt(const GLchar* name, int value, GLuint program) {
-        glUniform1i(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), value);
+        glUniform1i(getUniformLocation(name, program), value);
     }
     void setUniform(const GLchar* name, float value, GLuint program) {
-        glUniform1f(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), value);
+        glUniform1f(getUniformLocation(name, program), value);
     }
     void setUniform(const GLchar* name, vec2 value, GLuint program) {
-        glUniform2f(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), value.x, value.y);
+        glUniform2f(getUniformLocation(name, program), value.x, value.y);
     }
     void setUniform(const GLchar* name, vec3 value, GLuint program) {
-        glUniform3f(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), value.x, value.y, value.z);
+        glUniform3f(getUniformLocation(name, program), value.x, value.y, value.z);
     }
     void setUniform(const GLchar* name, vec4 value, GLuint program) {
-        glUniform4f(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), value.x, value.y, value.z, value.w);
+        glUniform4f(getUniformLocation(name, program), value.x, value.y, value.z, value.w);
     }
     void setUniform(const GLchar* name, mat4 value, GLuint program, GLboolean transpose) {
-        glUniformMatrix4fv(glGetUniformLocation(program ? program : getCurrentShaderProgram(), name), 1, transpose, value.elements);
+        glUniformMatrix4fv(getUniformLocation(name, program), 1, transpose, value.elements);
+    }
+
+    void setUniformInt(GLint location, int value) {
+        glUniform1i(location, value);
+    }
+    void setUniform(GLint location, float value) {
+        glUniform1f(location, value);
+    }
+    void setUniform(GLint location, vec2 value) {
+        glUniform2f(location, value.x, value.y);
+    }
+    void setUniform(GLint location, vec3 value) {
+        glUniform3f(location, value.x, value.y, value.z);
+    }
+    void setUniform(GLint location, vec4 value) {
+        glUniform4f(location, value.x, value.y, value.z, value.w);
+    }
+    void setUniform(GLint location, mat4 value, GLboolean transpose) {
+        glUniformMatrix4fv(location, 1, transpose, value.elements);
+    }
+
+    GLuint createUBO(GLuint binding, GLsizeiptr bytes, GLenum usage) {
+        GLuint UBO;
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+            glBufferData(GL_UNIFORM_BUFFER, bytes, NULL, usage);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+        return UBO;
+    }
+    void bindUniformBlock(const GLchar* name, GLuint binding, GLuint program) {
+        if (!program) program = getCurrentShaderProgram();
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, binding);
     }
 
     // Must have a texture currently bound
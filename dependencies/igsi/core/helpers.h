@@ -34,10 +34,14 @@ namespace Igsi {
     void set3(int idx, vec3 value);
     void set4(int idx, vec4 value);
 
-    // extern GLint currentShaderProgram;
-    // void useProgram(GLint shaderProgram);
+    // Use this instead of glUseProgram, so getCurrentShaderProgram doesn't have to ask GL (glGetIntegerv can stall the pipeline)
+    void useProgram(GLuint shaderProgram);
     GLuint getCurrentShaderProgram();
 
+    // Locations are looked up once per program and name, then cached
+    // To skip even the cache lookup, get the location once and use the overloads below that take it
+    GLint getUniformLocation(const GLchar* name, GLuint program=0);
+
     void setUniformInt(const GLchar* name, int value, GLuint program=0);
     void setUniform(const GLchar* name, float value, GLuint program=0);
     void setUniform(const GLchar* name, vec2 value, GLuint program=0);
@@ -45,6 +49,18 @@ namespace Igsi {
     void setUniform(const GLchar* name, vec4 value, GLuint program=0);
     void setUniform(const GLchar* name, mat4 value, GLuint program=0, GLboolean transpose=GL_FALSE);
 
+    // These set the uniform of the current program
+    void setUniformInt(GLint location, int value);
+    void setUniform(GLint location, float value);
+    void setUniform(GLint location, vec2 value);
+    void setUniform(GLint location, vec3 value);
+    void setUniform(GLint location, vec4 value);
+    void setUniform(GLint location, mat4 value, GLboolean transpose=GL_FALSE);
+
+    // Uniform blocks: fill the buffer with glBufferSubData following the block's std140 layout, and every program bound to the same binding sees it
+    GLuint createUBO(GLuint binding, GLsizeiptr bytes, GLenum usage=GL_DYNAMIC_DRAW);
+    void bindUniformBlock(const GLchar* name, GLuint binding, GLuint program=0);
+
     // Must have a texture currently bound
     void setTexParams(GLenum target, GLenum minFilter=GL_LINEAR, GLenum magFilter=GL_LINEAR, GLenum wrapS=GL_CLAMP_TO_EDGE, GLenum wrapT=GL_CLAMP_TO_EDGE, GLenum wrapR=GL_ZERO);
 }
@@ -57,7 +57,7 @@ namespace Igsi {
     void Skybox::draw(Transform* camera, mat4 projectionMatrix) {
         glCullFace(GL_FRONT);
 
-        glUseProgram(shaderProgram);
+        useProgram(shaderProgram);
         GLuint current = getCurrentShaderProgram();
         setUniform("projectionMatrix", projectionMatrix, current);
         setUniform("viewMatrix", camera->inverseWorldMatrix, current);
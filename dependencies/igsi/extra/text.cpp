@@ -76,7 +76,7 @@ namespace Igsi {
     }
     void Text::setFontTexture(unsigned int texUnit, vec2 fontTexDims) {
         charAspectRatio = (fontTexDims.x / 16.0) / (fontTexDims.y / 8.0);
-        glUseProgram(shaderProgram);
+        useProgram(shaderProgram);
         setUniformInt("map", texUnit);
     }
     void Text::updateText(std::string str) {
@@ -114,7 +114,7 @@ namespace Igsi {
     void Text::draw(float aspectRatio) {
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         glBlendEquation(GL_FUNC_ADD);
-        glUseProgram(shaderProgram);
+        useProgram(shaderProgram);
         GLuint current = getCurrentShaderProgram();
         setUniform("color", color, current);
         setUniform("offset", offset, current);
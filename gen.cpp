@@ -1,10 +1,11 @@
 #include "gen.h"
 #include "chunk.h"
-#include "chunkManager.h"
 
 #include "dependencies/igsi/core/vec3.h"
 
 #include <cmath>
+#include <vector>
+#include <mutex>
 
 using namespace Igsi;
 
@@ -78,45 +79,61 @@ namespace Voxels {
     }
 
     void ChunkGenerator::fillTerrain(Chunk* chunk) {
+        // Generate into a flat array and encode once at the end, so the palette is built with its final width
+        // rather than being widened voxel by voxel
+        std::vector<char> blocks(NUM_VOXELS);
+        int i = 0;
         for (int z = 0; z < chunkDims.z; z++) {
             for (int y = 0; y < chunkDims.y; y++) {
-                for (int x = 0; x < chunkDims.x; x++) {
-                    // chunk->setVoxel(vec3(x, y, z), 2);
+                for (int x = 0; x < chunkDims.x; x++, i++) {
+                    // blocks[i] = 2;
 
                     // Worst case -- 5x5x5 causes 100% GPU:
                     // bool state = (x + y + z) % 2 == 0;
-                    // chunk->setVoxel(vec3(x, y, z), state ? 2 : 0);
+                    // blocks[i] = state ? 2 : 0;
 
                     // vec3 state = hash(vec3(x, y, z));
-                    // chunk->setVoxel(vec3(x, y, z), (state.x + state.y + state.z) / 3.0 > -0.9 ? 2 : 0);
+                    // blocks[i] = (state.x + state.y + state.z) / 3.0 > -0.9 ? 2 : 0;
 
                     vec3 local = vec3(x, y, z);
                     float state = perlin3d(local / chunkDims + chunk->coords);
                     state += yGradient(y + chunk->coords.y * chunkDims.y);
-                    chunk->setVoxel(local, state > 0.0 ? 2 : 0);
+                    blocks[i] = state > 0.0 ? 2 : 0;
                 }
             }
         }
+        chunk->setVoxels(blocks.data());
     }
-    void ChunkGenerator::populateTerrain(Chunk* chunk, ChunkManager* chunkManager) {
+    void ChunkGenerator::populateTerrain(Chunk* chunk) {
+        // The bottom layer of the chunk above, copied once under its lock since another worker may be populating it right now
+        // Missing chunk reads as air, same as getVoxelLinked
+        // Done before locking this chunk, so this never holds two voxel locks at once
+        int w = chunkDims.x, d = chunkDims.z;
+        std::vector<char> aboveLayer(w * d, 0);
+        Chunk* chunkAbove = chunk->neighbors[Chunk::neighborIndex(0, 1, 0)];
+        if (chunkAbove != nullptr) chunkAbove->copyVoxels(0, 0, 0, w, 1, d, aboveLayer.data(), 0, w);
+
+        // Held from the decode to the encode, otherwise a setVoxelGlobal edit landing in between would be overwritten
+        std::lock_guard<std::mutex> lock(chunk->voxelMutex);
+        std::vector<char> blocks(NUM_VOXELS);
+        chunk->voxels.decode(blocks.data());
+
+        int i = 0;
         for (int z = 0; z < chunkDims.z; z++) {
             for (int y = 0; y < chunkDims.y; y++) {
-                for (int x = 0; x < chunkDims.x; x++) {
-                    vec3 local = vec3(x, y, z);
-                    char blockType = chunk->getVoxel(local);
+                for (int x = 0; x < chunkDims.x; x++, i++) {
+                    char blockType = blocks[i];
 
-                    // CANNOT ACCESS GLOBAL VOXEL WITHOUT CHUNKMANAGER -- THIS MUST STAY
-                    // CHUNKMANAGER NEEDS THIS FUNCTION -- SO THIS MUST CHANGE
-                    // CIRCULAR DEPENDENCY
-                    char above = chunkManager->getVoxelGlobal(local + vec3(0.0, 1.0, 0.0) + chunk->coords * chunkDims);
+                    char above = y + 1 < chunkDims.y ? blocks[i + w] : aboveLayer[x + z * w];
 
                     if (blockType != 0) {
                         if (above == 0) {
-                            chunk->setVoxel(local, 1);
+                            blocks[i] = 1;
                         }
                     }
                 }
             }
         }
+        chunk->voxels.encode(blocks.data());
     }
 }
\ No newline at end of file
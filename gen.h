@@ -7,7 +7,6 @@
 
 namespace Voxels {
     class Chunk;
-    class ChunkManager;
 
     // MAKE THESE ALL MEMBERS OF CHUNKGENERATOR
     // Or part of a math/utils file
@@ -22,7 +21,7 @@ namespace Voxels {
     class ChunkGenerator {
     public:
         void fillTerrain(Chunk* chunk);
-        void populateTerrain(Chunk* chunk, ChunkManager* chunkManager);
+        void populateTerrain(Chunk* chunk);
     };
 }
 
@@ -0,0 +1,114 @@
+#include "paletteStorage.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace Voxels {
+    PaletteStorage::PaletteStorage(int size, char blockType) {
+        this->size = size;
+        fill(blockType);
+    }
+
+    int PaletteStorage::findOrAdd(char blockType) {
+        // Palettes are tiny (usually 1-3 entries), so a linear search beats any kind of map here
+        for (int p = 0; p < palette.size(); p++) {
+            if (palette[p] == blockType) return p;
+        }
+        palette.push_back(blockType);
+        if (palette.size() > (1u << bitsPerIndex)) {
+            resize(bitsPerIndex == 0 ? 1 : bitsPerIndex * 2);
+        }
+        return palette.size() - 1;
+    }
+    int PaletteStorage::getIndex(int i) {
+        if (bitsPerIndex == 0) return 0;
+        int bit = i * bitsPerIndex;
+        std::uint32_t mask = (1u << bitsPerIndex) - 1;
+        return (words[bit >> 5] >> (bit & 31)) & mask;
+    }
+    void PaletteStorage::setIndex(int i, int paletteIndex) {
+        int bit = i * bitsPerIndex;
+        std::uint32_t mask = (1u << bitsPerIndex) - 1;
+        std::uint32_t &word = words[bit >> 5];
+        word = (word & ~(mask << (bit & 31))) | ((std::uint32_t)paletteIndex << (bit & 31));
+    }
+    void PaletteStorage::resize(int newBits) {
+        std::vector<std::uint32_t> oldWords;
+        oldWords.swap(words);
+        int oldBits = bitsPerIndex;
+
+        bitsPerIndex = newBits;
+        words.assign((size * newBits + 31) / 32, 0);
+
+        if (oldBits == 0) return; // Every index was 0, which is what the words were just zeroed to
+        std::uint32_t oldMask = (1u << oldBits) - 1;
+        for (int i = 0; i < size; i++) {
+            int bit = i * oldBits;
+            setIndex(i, (oldWords[bit >> 5] >> (bit & 31)) & oldMask);
+        }
+    }
+
+    char PaletteStorage::get(int i) {
+        return palette[getIndex(i)];
+    }
+    void PaletteStorage::set(int i, char blockType) {
+        if (bitsPerIndex == 0 && palette[0] == blockType) return; // Don't widen a uniform storage for a no-op write
+        setIndex(i, findOrAdd(blockType));
+    }
+    void PaletteStorage::fill(char blockType) {
+        palette.assign(1, blockType);
+        bitsPerIndex = 0;
+        std::vector<std::uint32_t>().swap(words);
+    }
+
+    void PaletteStorage::decode(char* out) {
+        if (bitsPerIndex == 0) {
+            std::fill(out, out + size, palette[0]);
+            return;
+        }
+        // Unpack a whole word at a time instead of recomputing the bit position for every voxel
+        int perWord = 32 / bitsPerIndex;
+        std::uint32_t mask = (1u << bitsPerIndex) - 1;
+        int i = 0;
+        for (int w = 0; w < words.size(); w++) {
+            std::uint32_t word = words[w];
+            for (int j = 0; j < perWord && i < size; j++, i++) {
+                out[i] = palette[word & mask];
+                word >>= bitsPerIndex;
+            }
+        }
+    }
+    void PaletteStorage::encode(const char* in) {
+        // Build the palette first so we know the final width, then pack in a single pass
+        palette.clear();
+        char lut[256];
+        bool seen[256] = {};
+        for (int i = 0; i < size; i++) {
+            unsigned char b = in[i];
+            if (!seen[b]) {
+                seen[b] = true;
+                lut[b] = palette.size();
+                palette.push_back(in[i]);
+            }
+        }
+
+        int newBits = 0;
+        while ((1u << newBits) < palette.size()) newBits = newBits == 0 ? 1 : newBits * 2;
+        bitsPerIndex = newBits;
+
+        if (newBits == 0) {
+            std::vector<std::uint32_t>().swap(words);
+            return;
+        }
+        std::vector<std::uint32_t>((size * newBits + 31) / 32, 0).swap(words); // Swap rather than assign so a narrower width also frees memory
+        for (int i = 0; i < size; i++) {
+            int bit = i * newBits;
+            words[bit >> 5] |= (std::uint32_t)(unsigned char)lut[(unsigned char)in[i]] << (bit & 31);
+        }
+    }
+
+    std::size_t PaletteStorage::memoryUsage() {
+        return palette.capacity() * sizeof(char) + words.capacity() * sizeof(std::uint32_t);
+    }
+}
\ No newline at end of file
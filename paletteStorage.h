@@ -0,0 +1,41 @@
+#ifndef VOXELS_PALETTESTORAGE_H
+#define VOXELS_PALETTESTORAGE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Voxels {
+    // Stores a fixed number of block ids as indices into a small palette of the distinct blocks present
+    // Indices are bit-packed into 32-bit words, and the width grows 0 -> 1 -> 2 -> 4 -> 8 bits as the palette fills up
+    // Widths are powers of two so an index never straddles two words
+    // With 0 bits (only one block type present) there is no index array at all
+    class PaletteStorage {
+    private:
+        int size;
+
+        int findOrAdd(char blockType);
+        int getIndex(int i);
+        void setIndex(int i, int paletteIndex);
+        void resize(int newBits); // Repacks all indices to newBits, which must be able to hold every current index
+    public:
+        std::vector<char> palette;
+        std::vector<std::uint32_t> words;
+        int bitsPerIndex;
+
+        PaletteStorage(int size, char blockType = 0);
+
+        char get(int i);
+        void set(int i, char blockType);
+        void fill(char blockType);
+
+        // Bulk paths, these are much faster than calling get/set for every voxel
+        void decode(char* out); // out must hold size chars
+        void encode(const char* in); // Rebuilds the palette from scratch, so unused entries get dropped
+
+        bool isUniform() { return bitsPerIndex == 0; }
+        std::size_t memoryUsage();
+    };
+}
+
+#endif
\ No newline at end of file
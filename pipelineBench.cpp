@@ -0,0 +1,86 @@
+// Headless benchmark of the chunk pipeline (ChunkUpdater's fill, populate and mesh workers), no window or GL context needed
+// Loads a 7x5x7 block of chunks and times how long until every one is meshed,
+// then edits a voxel 20 times and times how long each takes to come back rebuilt
+// mapQueue is drained here instead of by uploadMeshes, since that needs GL
+
+// Not part of the game, so don't compile it into \compiled (it has its own main)
+// Build it like voxels.cpp, with the "build active file" task, once the rest of the sources are in \compiled
+// or directly: g++ -O2 -Idependencies/glad/include pipelineBench.cpp chunk*.cpp gen.cpp frustum.cpp paletteStorage.cpp vertexArena.cpp stagingRing.cpp dependencies/glad/src/gl.c dependencies/igsi/core/*.cpp -lpthread
+
+#include "chunk.h"
+#include "chunkManager.h"
+#include "chunkUpdater.h"
+#include "gen.h"
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include <cstdio>
+#include <vector>
+#include <set>
+#include <thread>
+#include <chrono>
+
+using namespace Voxels;
+using namespace Igsi;
+
+ChunkManager chunkManager;
+ChunkGenerator chunkGenerator;
+// Same thread layout as the headless numbers in the commit log: 2 fill, 1 populate and 2 mesh threads
+ChunkUpdater chunkUpdater(&chunkManager, &chunkGenerator, 2, 2);
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Stands in for uploadMeshes: takes one built chunk off mapQueue so it can be queued again
+bool takeBuilt(ChunkId &id) {
+    if (!chunkUpdater.mapQueue.pop(id)) return false;
+    Chunk* chunk = chunkManager.findChunk(id);
+    if (chunk != nullptr) chunk->uploadQueued = false;
+    return true;
+}
+
+int main() {
+    int numChunks = 0;
+    for (int x = -3; x <= 3; x++) {
+        for (int y = -5; y < 0; y++) {
+            for (int z = -3; z <= 3; z++) {
+                chunkManager.addChunk(vec3(x, y, z));
+                chunkUpdater.fillQueue.push(ChunkManager::coordsToId(vec3(x, y, z)));
+                numChunks++;
+            }
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < chunkUpdater.numFillWorkers; i++) threads.push_back(std::thread([] { while (chunkUpdater.fillNext()); }));
+    threads.push_back(std::thread([] { while (chunkUpdater.populateNext()); }));
+    for (int i = 0; i < chunkUpdater.numMeshWorkers; i++) threads.push_back(std::thread([i] { while (chunkUpdater.buildNext(i)); }));
+
+    std::set<ChunkId> built;
+    ChunkId id;
+    while (built.size() < numChunks) {
+        if (takeBuilt(id)) built.insert(id);
+        else std::this_thread::yield();
+    }
+    std::printf("%d chunks ready in %.0f ms\n", numChunks, millisecondsSince(start));
+
+    // The chunks are idle by now, so this is the latency of one rebuild from push to published mesh
+    const int numEdits = 20;
+    double totalMs = 0;
+    for (int i = 0; i < numEdits; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::chrono::steady_clock::time_point editStart = std::chrono::steady_clock::now();
+        chunkManager.setVoxelGlobal(vec3(i, -3, 0), 1);
+        chunkUpdater.buildQueue.push(ChunkManager::coordsToId(vec3(0, -1, 0)));
+        while (!takeBuilt(id)) std::this_thread::yield();
+        totalMs += millisecondsSince(editStart);
+    }
+    std::printf("edit -> rebuilt mesh: %.2f ms average over %d edits\n", totalMs / numEdits, numEdits);
+
+    chunkUpdater.shutdown();
+    for (int i = 0; i < threads.size(); i++) threads[i].join();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+// Benchmark of the work queues in chunkUpdater.h: 4 producers push the ids 0 to 99999, 4 consumers pop them all
+// Compares SafeUniqueQueue and MPMCQueue against the old deque that deduplicated pushes with std::find,
+// and checks every id was popped exactly once
+
+// Not part of the game, so don't compile it into \compiled (it has its own main)
+// Build it like voxels.cpp, with the "build active file" task, once the rest of the sources are in \compiled
+// or directly: g++ -O2 -Idependencies/glad/include queueBench.cpp chunk*.cpp gen.cpp frustum.cpp paletteStorage.cpp vertexArena.cpp stagingRing.cpp dependencies/glad/src/gl.c dependencies/igsi/core/*.cpp -lpthread
+
+#include "chunkUpdater.h"
+
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+using namespace Voxels;
+
+const int NUM_IDS = 100000;
+const int NUM_PRODUCERS = 4;
+const int NUM_CONSUMERS = 4;
+
+// What SafeUniqueQueue used to be, every push searched the whole queue
+class FindQueue {
+private:
+    std::mutex m;
+    std::deque<ChunkId> q;
+public:
+    bool push(ChunkId elem) {
+        std::lock_guard<std::mutex> lock(m);
+        if (std::find(q.begin(), q.end(), elem) == q.end()) q.push_back(elem);
+        return true;
+    }
+    bool pop(ChunkId &elem) {
+        std::lock_guard<std::mutex> lock(m);
+        if (q.empty()) return false;
+        elem = q.front();
+        q.pop_front();
+        return true;
+    }
+};
+
+// SafeUniqueQueue::push returns void, the benchmark wants MPMCQueue's interface
+class UniqueQueue {
+public:
+    SafeUniqueQueue<ChunkId> q;
+    bool push(ChunkId elem) { q.push(elem); return true; }
+    bool pop(ChunkId &elem) { return q.pop(elem); }
+};
+
+template <typename Q>
+void bench(Q &queue, const char* name) {
+    std::atomic<int> popped(0);
+    std::atomic<long long> sum(0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < NUM_PRODUCERS; p++) {
+        threads.push_back(std::thread([&queue, p] {
+            for (int i = p; i < NUM_IDS; i += NUM_PRODUCERS) {
+                while (!queue.push((ChunkId)i)) std::this_thread::yield(); // Only MPMCQueue can be full
+            }
+        }));
+    }
+    for (int c = 0; c < NUM_CONSUMERS; c++) {
+        threads.push_back(std::thread([&queue, &popped, &sum] {
+            ChunkId id;
+            while (popped < NUM_IDS) {
+                if (queue.pop(id)) {
+                    popped++;
+                    sum += id;
+                }
+                else std::this_thread::yield();
+            }
+        }));
+    }
+    for (int i = 0; i < threads.size(); i++) threads[i].join();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Every id pushed once and nothing popped twice, so the sum has to be 0 + 1 + ... + (NUM_IDS - 1)
+    bool exact = sum == (long long)NUM_IDS * (NUM_IDS - 1) / 2;
+    std::printf("%-24s %8.1f ms  %s\n", name, ms, exact ? "(every id once)" : "(WRONG)");
+}
+
+int main() {
+    FindQueue findQueue;
+    UniqueQueue uniqueQueue;
+    MPMCQueue<ChunkId> mpmcQueue(1 << 16); // Same size as ChunkUpdater::mapQueue
+
+    bench(findQueue, "deque + std::find");
+    bench(uniqueQueue, "SafeUniqueQueue");
+    bench(mpmcQueue, "MPMCQueue (lock-free)");
+    return 0;
+}
\ No newline at end of file
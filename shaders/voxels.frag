@@ -2,12 +2,17 @@
 
 uniform sampler2D map;
 uniform samplerCube fogMap;
-uniform vec3 cameraPosition;
+// Shared by the chunk programs, filled once per frame by render() in voxels.cpp
+layout (std140) uniform Camera {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 cameraPosition;
+};
 
 // in float vAo;
 in vec2 vUv;
 in vec4 vAo;
-in float vUvOffsetX;
+flat in float vAtlasIndex;
 
 in vec3 worldPosition;
 
@@ -16,12 +21,16 @@ out vec4 fragColor;
 void main() {
     vec3 color = vec3(0.8, 0.4, 0.3);
 
-    float top = mix(vAo.x, vAo.y, vUv.x);
-    float bottom = mix(vAo.z, vAo.w, vUv.x);
-    float ao = mix(bottom, top, vUv.y);
+    // Repeat once per block, a quad merged by greedy meshing has the same texture and AO on every block it covers
+    vec2 uv = fract(vUv);
+
+    float top = mix(vAo.x, vAo.y, uv.x);
+    float bottom = mix(vAo.z, vAo.w, uv.x);
+    float ao = mix(bottom, top, uv.y);
     // ao = ao * 0.5 + 0.5;
 
-    color = texture(map, vec2(vUvOffsetX, 1.0 - vUv.y)).rgb; // Flipped uv y because texture is flipped
+    float uvOffsetX = (uv.x + vAtlasIndex) / 12; // NUM_ATLAS_FACES
+    color = texture(map, vec2(uvOffsetX, 1.0 - uv.y)).rgb; // Flipped uv y because texture is flipped
 
     fragColor = vec4(color * ao, 1.0);
     // fragColor = vec4(vUv, 0.0, 1.0);
@@ -6,13 +6,21 @@ layout (location = 1) in uint UVAO;
 
 out vec2 vUv;
 out vec4 vAo;
-out float vUvOffsetX;
+flat out float vAtlasIndex;
 
 out vec3 worldPosition;
 
-uniform mat4 worldMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 projectionMatrix;
+// World position of each chunk, one per vertex arena block. Vertices are Chunk::STRIDE GLuints each,
+// so the block a vertex lives in is gl_VertexID / verticesPerBlock (gl_VertexID includes first and the base vertex)
+uniform samplerBuffer origins;
+uniform int verticesPerBlock;
+
+// Shared by the chunk programs, filled once per frame by render() in voxels.cpp
+layout (std140) uniform Camera {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 cameraPosition;
+};
 // Normal matrix is silently ignored because get uniform location returns -1
 
 // vec3 unpackPositionCustom(uint ret) {
@@ -24,22 +32,23 @@ uniform mat4 projectionMatrix;
 
 void main() {
     vAo = vec4(
-        (UVAO >> 16) & 0x3u,
         (UVAO >> 18) & 0x3u,
         (UVAO >> 20) & 0x3u,
+        (UVAO >> 22) & 0x3u,
         (UVAO >> 24) & 0x3u
     ) / 3.0;
 
+    // In blocks, greedy quads go past 1 so the texture repeats
     vUv = vec2(
-        UVAO & 0xfu,
-        (UVAO >> 4) & 0xfu
-    ) / 15.0;
-    float uvOffset = (UVAO >> 8) & 0xffu;
-    vUvOffsetX = (vUv.x + uvOffset) / 12; // NUM_ATLAS_FACES
+        UVAO & 0x1fu,
+        (UVAO >> 5) & 0x1fu
+    );
+    vAtlasIndex = (UVAO >> 10) & 0xffu;
 
-    gl_Position = worldMatrix * vec4(position / 16.0, 1.0);
+    vec3 origin = texelFetch(origins, gl_VertexID / verticesPerBlock).xyz;
+    gl_Position = vec4(origin + position / 16.0, 1.0);
     // vec3 realPos = unpackPositionCustom(position);
-    // gl_Position = worldMatrix * vec4(realPos, 1.0);
+    // gl_Position = vec4(origin + realPos, 1.0);
 
     worldPosition = gl_Position.xyz;
     gl_Position = projectionMatrix * viewMatrix * gl_Position;
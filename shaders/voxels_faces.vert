@@ -0,0 +1,65 @@
+#version 330 core
+
+// Vertex pulling for the FACES mesh layout: there are no vertex attributes,
+// each face is one GLuint in the faces buffer texture and is drawn as 6 vertices,
+// so the face is texelFetch(faces, gl_VertexID / 6) and the corner is gl_VertexID % 6
+// See Chunk::addFaceRecord for the packing
+
+uniform usamplerBuffer faces;
+
+out vec2 vUv;
+out vec4 vAo;
+flat out float vAtlasIndex;
+
+out vec3 worldPosition;
+
+// World position of each chunk, one per vertex arena block, which holds facesPerBlock faces (see voxels.vert)
+uniform samplerBuffer origins;
+uniform int facesPerBlock;
+
+// Shared by the chunk programs, filled once per frame by render() in voxels.cpp
+layout (std140) uniform Camera {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 cameraPosition;
+};
+
+// Same as faceVertexData in chunk.cpp, in faceId order
+const vec3 corners[36] = vec3[36](
+    vec3(0, 1, 1), vec3(0, 0, 1), vec3(1, 1, 1), vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 1, 1), // N
+    vec3(1, 1, 0), vec3(1, 0, 0), vec3(0, 1, 0), vec3(1, 0, 0), vec3(0, 0, 0), vec3(0, 1, 0), // S
+    vec3(1, 1, 1), vec3(1, 0, 1), vec3(1, 1, 0), vec3(1, 0, 1), vec3(1, 0, 0), vec3(1, 1, 0), // E
+    vec3(0, 1, 0), vec3(0, 0, 0), vec3(0, 1, 1), vec3(0, 0, 0), vec3(0, 0, 1), vec3(0, 1, 1), // W
+    vec3(0, 1, 0), vec3(0, 1, 1), vec3(1, 1, 0), vec3(0, 1, 1), vec3(1, 1, 1), vec3(1, 1, 0), // T
+    vec3(0, 0, 1), vec3(0, 0, 0), vec3(1, 0, 1), vec3(0, 0, 0), vec3(1, 0, 0), vec3(1, 0, 1) // B
+);
+// Same as uvData in chunk.cpp
+const vec2 uvs[6] = vec2[6](vec2(0, 1), vec2(0, 0), vec2(1, 1), vec2(0, 0), vec2(1, 0), vec2(1, 1));
+
+void main() {
+    uint record = texelFetch(faces, gl_VertexID / 6).r;
+    int corner = gl_VertexID % 6;
+
+    vec3 local = vec3(
+        record & 0xfu,
+        (record >> 4) & 0xfu,
+        (record >> 8) & 0xfu
+    );
+    int faceId = int((record >> 12) & 0x7u);
+
+    vAo = vec4(
+        (record >> 23) & 0x3u,
+        (record >> 25) & 0x3u,
+        (record >> 27) & 0x3u,
+        (record >> 29) & 0x3u
+    ) / 3.0;
+
+    vUv = uvs[corner];
+    vAtlasIndex = (record >> 15) & 0xffu;
+
+    vec3 origin = texelFetch(origins, gl_VertexID / 6 / facesPerBlock).xyz;
+    gl_Position = vec4(origin + local + corners[faceId * 6 + corner], 1.0);
+
+    worldPosition = gl_Position.xyz;
+    gl_Position = projectionMatrix * viewMatrix * gl_Position;
+}
\ No newline at end of file
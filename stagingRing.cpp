@@ -0,0 +1,61 @@
+#include "stagingRing.h"
+
+#include <glad/gl.h>
+
+#include <deque>
+#include <cstring>
+
+namespace Voxels {
+    StagingRing::StagingRing(GLsizeiptr ringBytes) {
+        this->ringBytes = ringBytes;
+        buffer = 0;
+        head = 0;
+        frameBegin = 0;
+    }
+
+    bool StagingRing::isDone(GLsync fence) {
+        GLenum result = glClientWaitSync(fence, 0, 0); // Timeout 0 only polls
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+
+    bool StagingRing::upload(const void* data, GLsizeiptr bytes, GLuint dst, GLintptr dstOffset) {
+        if (bytes <= 0 || bytes > ringBytes) return false;
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glBufferData(GL_COPY_READ_BUFFER, ringBytes, NULL, GL_STREAM_DRAW);
+        }
+
+        // Writes never wrap around the end of the buffer, they skip to the start instead
+        long long begin = head;
+        if (begin % ringBytes + bytes > ringBytes) begin += ringBytes - begin % ringBytes;
+
+        // Everything written before limit is on the other side of the ring, so only older writes from before it can overlap
+        long long limit = begin + bytes - ringBytes;
+        if (frameBegin < limit) return false; // This frame alone already went around the ring
+        while (!batches.empty()) {
+            bool done = isDone(batches.front().fence);
+            if (!done && batches.front().begin >= limit) break; // Still being read, but not in the way (and neither is anything newer)
+            if (!done) return false;
+            glDeleteSync(batches.front().fence);
+            batches.pop_front();
+        }
+
+        GLintptr offset = begin % ringBytes;
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        void* mapped = glMapBufferRange(GL_COPY_READ_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (mapped == NULL) return false;
+        std::memcpy(mapped, data, bytes);
+        if (glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE) return false; // Contents got lost, e.g. on a display mode change
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, dstOffset, bytes);
+        head = begin + bytes;
+        return true;
+    }
+    void StagingRing::endFrame() {
+        if (head == frameBegin) return;
+        batches.push_back(Batch{ frameBegin, head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+        frameBegin = head;
+    }
+}
\ No newline at end of file
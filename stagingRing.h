@@ -0,0 +1,39 @@
+#ifndef VOXELS_STAGINGRING_H
+#define VOXELS_STAGINGRING_H
+
+#include <glad/gl.h>
+
+#include <deque>
+
+namespace Voxels {
+    // Uploads go through one streaming buffer used as a ring: data is written into the next free range with an unsynchronized map,
+    // then glCopyBufferSubData moves it to its destination on the GPU, so the driver never has to stall a map or a glBufferSubData
+    // on draws that still read the destination
+    // Instead, each frame's writes are guarded by a fence, and a range is only written again once its fence has signaled
+    // Created lazily like VertexArena, so it can be constructed before there is a GL context
+    class StagingRing {
+    private:
+        // Positions only ever grow, the offset in the buffer is position % ringBytes
+        struct Batch {
+            long long begin, end;
+            GLsync fence;
+        };
+        GLuint buffer;
+        long long head; // Where the next write goes
+        long long frameBegin; // Start of the writes not fenced yet
+        std::deque<Batch> batches; // Oldest first
+
+        bool isDone(GLsync fence);
+    public:
+        GLsizeiptr ringBytes;
+
+        StagingRing(GLsizeiptr ringBytes);
+
+        // Copies bytes of data into dst at dstOffset. Returns false without doing anything if the ring has no room for it right now,
+        // because the GPU hasn't finished with the frames that used that part of the ring yet
+        bool upload(const void* data, GLsizeiptr bytes, GLuint dst, GLintptr dstOffset);
+        void endFrame(); // Fences the uploads made since the last endFrame
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "vertexArena.h"
+#include "chunk.h"
+
+#include <glad/gl.h>
+
+#include "dependencies/igsi/core/helpers.h"
+#include "dependencies/igsi/core/vec3.h"
+
+#include <vector>
+#include <map>
+#include <iterator>
+#include <algorithm>
+
+using namespace Igsi;
+
+namespace Voxels {
+    // The staging ring gets a page's worth, which is a few frames of uploads at ChunkUpdater's default budget
+    VertexArena::VertexArena(GLsizeiptr pageBytes, GLsizeiptr budgetBytes) : staging(pageBytes) {
+        this->pageBytes = pageBytes;
+        this->budgetBytes = budgetBytes;
+        usedBytes = 0;
+        emptyVAO = 0;
+        quadEBO = 0;
+        maxTextureBufferSize = 0;
+    }
+
+    bool VertexArena::addPage() {
+        if (capacityBytes() + pageBytes > budgetBytes) return false;
+
+        Page page;
+        page.VAO = createVAO();
+            glGenBuffers(1, &page.VBO);
+            glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+                glBufferData(GL_ARRAY_BUFFER, pageBytes, NULL, GL_DYNAMIC_DRAW);
+
+                glVertexAttribPointer(0, 4, GL_INT_2_10_10_10_REV, GL_FALSE, Chunk::STRIDE * sizeof(GLuint), (void*)0);
+                glEnableVertexAttribArray(0);
+
+                // ...IPointer, no normalize
+                glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, Chunk::STRIDE * sizeof(GLuint), (void*)(sizeof(GLuint)));
+                glEnableVertexAttribArray(1);
+
+            // Built once and never changes, every chunk draws it from index 0 with its own base vertex
+            if (quadEBO == 0) {
+                int numQuads = MAX_VERTS / 6;
+                std::vector<GLuint> indices(numQuads * 6);
+                for (int q = 0; q < numQuads; q++) {
+                    for (int i = 0; i < 6; i++) indices[q * 6 + i] = q * 4 + quadIndices[i];
+                }
+                glGenBuffers(1, &quadEBO);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+            }
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO); // Part of the VAO's state
+
+        page.texture = createTexture(GL_TEXTURE_BUFFER, TEXTURE_UNIT);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, page.VBO);
+
+        // RGBA rather than RGB, a buffer texture can't be RGB32F before GL 4.0
+        glGenBuffers(1, &page.originBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, page.originBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, pageBytes / BLOCK_BYTES * 4 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+        page.originTexture = createTexture(GL_TEXTURE_BUFFER, ORIGIN_TEXTURE_UNIT);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, page.originBuffer);
+
+        page.freeRanges[0] = pageBytes;
+        pages.push_back(page);
+        return true;
+    }
+
+    bool VertexArena::allocate(GLsizeiptr bytes, ArenaAllocation &allocation) {
+        bytes = (bytes + BLOCK_BYTES - 1) / BLOCK_BYTES * BLOCK_BYTES;
+        if (bytes > pageBytes) return false;
+
+        for (int p = 0; ; p++) {
+            if (p == pages.size() && !addPage()) return false;
+
+            std::map<GLsizeiptr, GLsizeiptr> &freeRanges = pages[p].freeRanges;
+            for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+                if (it->second < bytes) continue;
+
+                allocation.page = p;
+                allocation.offset = it->first;
+                allocation.bytes = bytes;
+
+                // Take the front of the range and put back whatever is left over
+                GLsizeiptr remaining = it->second - bytes;
+                freeRanges.erase(it);
+                if (remaining > 0) freeRanges[allocation.offset + bytes] = remaining;
+
+                usedBytes += bytes;
+                return true;
+            }
+        }
+    }
+    void VertexArena::free(ArenaAllocation &allocation) {
+        if (allocation.page < 0) return;
+
+        std::map<GLsizeiptr, GLsizeiptr> &freeRanges = pages[allocation.page].freeRanges;
+        auto it = freeRanges.emplace(allocation.offset, allocation.bytes).first;
+
+        // Merge with the following range, then the preceding one
+        auto next = std::next(it);
+        if (next != freeRanges.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            freeRanges.erase(next);
+        }
+        if (it != freeRanges.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                freeRanges.erase(it);
+            }
+        }
+
+        usedBytes -= allocation.bytes;
+        allocation = ArenaAllocation();
+    }
+
+    void VertexArena::upload(ArenaAllocation &allocation, const void* data, GLsizeiptr bytes) {
+        GLuint VBO = pages[allocation.page].VBO;
+        if (staging.upload(data, bytes, VBO, allocation.offset)) return;
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, allocation.offset, bytes, data);
+    }
+
+    void VertexArena::setOrigin(ArenaAllocation &allocation, vec3 origin) {
+        int numBlocks = allocation.bytes / BLOCK_BYTES;
+        std::vector<GLfloat> origins(numBlocks * 4);
+        for (int i = 0; i < numBlocks; i++) {
+            origins[i * 4] = origin.x;
+            origins[i * 4 + 1] = origin.y;
+            origins[i * 4 + 2] = origin.z;
+            origins[i * 4 + 3] = 1.0;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, pages[allocation.page].originBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, allocation.offset / BLOCK_BYTES * 4 * sizeof(GLfloat), origins.size() * sizeof(GLfloat), origins.data());
+    }
+
+    void VertexArena::bind(int page) {
+        glBindVertexArray(pages[page].VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, pages[page].VBO);
+        glActiveTexture(GL_TEXTURE0 + ORIGIN_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, pages[page].originTexture);
+    }
+    void VertexArena::bindFaces(int page) {
+        if (emptyVAO == 0) glGenVertexArrays(1, &emptyVAO);
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, pages[page].texture);
+        glActiveTexture(GL_TEXTURE0 + ORIGIN_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, pages[page].originTexture);
+        glBindBuffer(GL_ARRAY_BUFFER, pages[page].VBO);
+    }
+
+    bool VertexArena::supportsFaces() {
+        if (maxTextureBufferSize == 0) glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+        return pageBytes / (GLsizeiptr)sizeof(GLuint) <= maxTextureBufferSize;
+    }
+
+    GLsizeiptr VertexArena::largestFreeRange() {
+        GLsizeiptr largest = 0;
+        for (int p = 0; p < pages.size(); p++) {
+            for (auto it = pages[p].freeRanges.begin(); it != pages[p].freeRanges.end(); ++it) {
+                largest = std::max(largest, it->second);
+            }
+        }
+        return largest;
+    }
+    float VertexArena::fragmentation() {
+        GLsizeiptr freeBytes = capacityBytes() - usedBytes;
+        if (freeBytes == 0) return 0.0;
+        return 1.0 - (float)largestFreeRange() / freeBytes;
+    }
+}
\ No newline at end of file
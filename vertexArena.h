@@ -0,0 +1,75 @@
+#ifndef VOXELS_VERTEXARENA_H
+#define VOXELS_VERTEXARENA_H
+
+#include <glad/gl.h>
+
+#include "dependencies/igsi/core/vec3.h"
+
+#include "stagingRing.h"
+
+#include <vector>
+#include <map>
+
+namespace Voxels {
+    struct ArenaAllocation {
+        int page = -1; // -1 means nothing is allocated
+        GLsizeiptr offset = 0; // In bytes, always a multiple of VertexArena::BLOCK_BYTES
+        GLsizeiptr bytes = 0;
+    };
+
+    // All chunk meshes live in a few large VBOs ("pages") that share the same vertex format,
+    // so each chunk only needs an (offset, count) into a page instead of its own VAO and VBO
+    // Each page keeps a free list of byte ranges, allocations are first-fit and freed ranges get merged with their neighbors
+    // Pages are created lazily, so this can be constructed before there is a GL context,
+    // but allocate() and anything that draws must be called from the thread with the GL context
+    class VertexArena {
+    private:
+        struct Page {
+            GLuint VAO;
+            GLuint VBO;
+            GLuint texture; // Views VBO as a buffer texture of GLuints, for meshes in the FACES layout
+            // One vec4 per block, the world position of the chunk whose mesh is in that block (see setOrigin)
+            // A vertex's block follows from gl_VertexID, so one draw call can cover the meshes of many chunks
+            GLuint originBuffer;
+            GLuint originTexture;
+            std::map<GLsizeiptr, GLsizeiptr> freeRanges; // offset -> size, ordered by offset so neighbors can be merged
+        };
+        std::vector<Page> pages;
+        GLuint emptyVAO; // The FACES layout has no vertex attributes, but core profile still needs some VAO bound to draw
+        GLuint quadEBO; // quadIndices repeated for the largest possible mesh, shared by every page's VAO for the QUADS layout
+        GLint maxTextureBufferSize; // In texels, 0 until supportsFaces() asks GL for it
+
+        bool addPage();
+    public:
+        static const GLsizeiptr BLOCK_BYTES = 1024; // Allocation granularity
+        static const GLint TEXTURE_UNIT = 3; // Where bindFaces puts the page's buffer texture
+        static const GLint ORIGIN_TEXTURE_UNIT = 4; // Where bind and bindFaces put the page's origins
+
+        GLsizeiptr pageBytes;
+        GLsizeiptr budgetBytes; // Hard limit on the total size of all pages
+        GLsizeiptr usedBytes;
+        StagingRing staging;
+
+        VertexArena(GLsizeiptr pageBytes, GLsizeiptr budgetBytes);
+
+        bool allocate(GLsizeiptr bytes, ArenaAllocation &allocation); // Returns false if the budget would be exceeded
+        void free(ArenaAllocation &allocation);
+        // Writes data to the start of the allocation through staging, or with glBufferSubData if staging has no room for it
+        // Call staging.endFrame() after the last upload of each frame
+        void upload(ArenaAllocation &allocation, const void* data, GLsizeiptr bytes);
+        void setOrigin(ArenaAllocation &allocation, Igsi::vec3 origin); // For every block of the allocation
+
+        void bind(int page); // Binds the page's VAO and VBO, and its origins to ORIGIN_TEXTURE_UNIT
+        void bindFaces(int page); // Binds the page's buffer texture to TEXTURE_UNIT, its origins to ORIGIN_TEXTURE_UNIT, and an empty VAO
+        // Whether a whole page fits in one buffer texture of GLuints, which the FACES layout needs
+        // GL 3.3 only guarantees GL_MAX_TEXTURE_BUFFER_SIZE >= 65536 texels, far less than a page, so don't use FACES when this is false
+        bool supportsFaces();
+
+        // Stats
+        GLsizeiptr capacityBytes() { return pages.size() * pageBytes; }
+        GLsizeiptr largestFreeRange();
+        float fragmentation(); // 0 when all free space is one contiguous range, approaches 1 as it gets split into small pieces
+    };
+}
+
+#endif
\ No newline at end of file
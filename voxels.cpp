@@ -17,15 +17,19 @@
 
 #include "chunk.h"
 #include "chunkManager.h"
+#include "chunkGrid.h"
 #include "gen.h"
 #include "chunkUpdater.h"
+#include "chunkStreamer.h"
 #include "frustum.h"
+#include "vertexArena.h"
 
 
 #include <iostream>
 #include <thread>
-// #include <vector>
+#include <vector>
 #include <chrono>
+#include <algorithm>
 
 #include <sstream>
 #include <iomanip>
@@ -49,6 +53,16 @@ namespace Voxels {
         else if (action == GLFW_RELEASE) mouseBtn = -1;
     }
 
+    // G: toggle greedy meshing, so vertex counts and frame times can be compared against the per-face mesher
+    // L: cycle through the mesh layouts (see MeshLayout)
+    bool toggleGreedy = false;
+    bool cycleLayout = false;
+    void onKey(GLFWwindow* window, int key, int scancode, int action, int mods) {
+        Controls::keyEvent(window, key, scancode, action, mods);
+        if (key == GLFW_KEY_G && action == GLFW_PRESS) toggleGreedy = true;
+        if (key == GLFW_KEY_L && action == GLFW_PRESS) cycleLayout = true;
+    }
+
     int currentBlockId = 0;
     void onScroll(GLFWwindow* window, double xoffset, double yoffset) {
         currentBlockId += (yoffset > 0) - (yoffset < 0); // Sign function
@@ -82,8 +96,16 @@ namespace Voxels {
     }
 
     ChunkManager chunkManager;
+    // Fixed ring buffer instead of a hash table: big enough for ChunkStreamer's unload range in render() (2 * 5 + 1), and for edits up to y = 2
+    // ChunkManager chunkManager(new ChunkGrid(11, 8, 11));
     ChunkGenerator chunkGenerator; // MB different instances for different terrain parameters
-    ChunkUpdater chunkUpdater(&chunkManager, &chunkGenerator);
+    // Filling and meshing split the cores left over after the main, render and populate threads,
+    // since ChunkStreamer keeps both pools busy at the same time while the camera moves
+    // Meshing gets the bigger share, a chunk takes several times longer to mesh than to fill
+    const int spareCores = std::max(2, (int)std::thread::hardware_concurrency() - 3);
+    const int numFillWorkers = std::max(1, spareCores / 3);
+    const int numMeshWorkers = std::max(1, spareCores - numFillWorkers);
+    ChunkUpdater chunkUpdater(&chunkManager, &chunkGenerator, numFillWorkers, numMeshWorkers);
 
     // Next steps: Try a rudimentary test for flood fillling
     // If it is still performant enough, you can try minecraft's cave culling algo
@@ -91,23 +113,16 @@ namespace Voxels {
     // Related: https://www.youtube.com/watch?v=UMYFEYju40k
 
 
-    // These threads ait a bit until next loop iteration so cpu doesnt overwork itself by running this loop at warp speed
-    // MB decrease waiting time a bit
+    // These threads sleep inside the queues until there is work, and stop once main calls chunkUpdater.shutdown()
 
     void chunkFillThread() {
-        while (!glfwWindowShouldClose(window)) {
-            chunkUpdater.fillNext();
-        }
+        while (chunkUpdater.fillNext());
     }
     void chunkPopulateThread() {
-        while (!glfwWindowShouldClose(window)) {
-            chunkUpdater.populateNext();
-        }
+        while (chunkUpdater.populateNext());
     }
-    void chunkGeoThread() {
-        while (!glfwWindowShouldClose(window)) {
-            chunkUpdater.buildNext();
-        }
+    void chunkGeoThread(int worker) {
+        while (chunkUpdater.buildNext(worker));
     }
 
     void render() {
@@ -120,7 +135,7 @@ namespace Voxels {
         mat4 projectionMatrix = mat4().perspective(60 * TO_RADIANS, width / height, 0.1, 1000);
         Frustum frustum(60 * TO_RADIANS, width / height, 0.1, 1000);
 
-        glfwSetKeyCallback(window, Controls::keyEvent);
+        glfwSetKeyCallback(window, onKey);
         glfwSetMouseButtonCallback(window, onClick);
         glfwSetWindowFocusCallback(window, Controls::focusEvent);
         glfwSetScrollCallback(window, onScroll);
@@ -144,11 +159,47 @@ namespace Voxels {
         Text debugText(30, vec2(-0.99, 1), vec2(0.1), vec3(1.0), Text::LEFT);
         debugText.setFontTexture(2, fontTexDims);
 
+        Text memoryText(60, vec2(-0.99, 1), vec2(0.1), vec3(1.0), Text::LEFT);
+        memoryText.setFontTexture(2, fontTexDims);
+
+        Text meshText(70, vec2(-0.99, 1), vec2(0.1), vec3(1.0), Text::LEFT);
+        meshText.setFontTexture(2, fontTexDims);
+
+        Text uploadText(60, vec2(-0.99, 1), vec2(0.1), vec3(1.0), Text::LEFT);
+        uploadText.setFontTexture(2, fontTexDims);
+
         // ======= Chunks =======
 
-        GLuint chunkProgram = createShaderProgram(readFile("./shaders/voxels.vert"), readFile("./shaders/voxels.frag"));
+        std::string voxels_frag = readFile("./shaders/voxels.frag");
+
+        // Chunk origins -- texUnit 4 (see VertexArena::bind)
+        GLuint chunkProgram = createShaderProgram(readFile("./shaders/voxels.vert"), voxels_frag);
+        setUniformInt("fogMap", 0);
+        setUniformInt("map", 1);
+        setUniformInt("origins", VertexArena::ORIGIN_TEXTURE_UNIT);
+        setUniformInt("verticesPerBlock", VertexArena::BLOCK_BYTES / (Chunk::STRIDE * sizeof(GLuint)));
+
+        // ======= Face records -- texUnit 3 (see VertexArena::bindFaces) =======
+
+        GLuint chunkFacesProgram = createShaderProgram(readFile("./shaders/voxels_faces.vert"), voxels_frag);
         setUniformInt("fogMap", 0);
         setUniformInt("map", 1);
+        setUniformInt("faces", VertexArena::TEXTURE_UNIT);
+        setUniformInt("origins", VertexArena::ORIGIN_TEXTURE_UNIT);
+        setUniformInt("facesPerBlock", VertexArena::BLOCK_BYTES / sizeof(GLuint));
+
+        // ======= Camera block -- binding 0 =======
+
+        // std140 layout of the Camera block in the chunk shaders: view matrix, projection matrix, camera position (padded to a vec4)
+        const GLuint cameraBinding = 0;
+        GLfloat cameraBlock[36] = { 0 };
+        GLuint cameraUBO = createUBO(cameraBinding, sizeof(cameraBlock));
+        bindUniformBlock("Camera", cameraBinding, chunkProgram);
+        bindUniformBlock("Camera", cameraBinding, chunkFacesProgram);
+
+        chunkManager.programs[TRIANGLES] = chunkProgram;
+        chunkManager.programs[QUADS] = chunkProgram;
+        chunkManager.programs[FACES] = chunkFacesProgram;
 
         // horiz range = 3 + 3 + 1 = 7 chunks
         // vert range = -5, -4, -3, -2, -1 = 5 chunks
@@ -159,16 +210,8 @@ namespace Voxels {
         // const int renderDistance = 5;
         const int renderDistance = 3;
 
-        for (int x = -renderDistance; x <= renderDistance; x++) {
-            for (int y = -5; y < 0; y++) {
-                for (int z = -renderDistance; z <= renderDistance; z++) {
-                    Chunk &ch = chunkManager.addChunk(vec3(x, y, z));
-                    chunkUpdater.fillQueue.push_back(ChunkManager::coordsToId(vec3(x, y, z))); // MB later on put this directly inside addChunk?
-                }
-            }
-        }
-        // MB set numNeighbors of neighboring chunks in addChunk
-        // rather than in fill data
+        // Chunks get loaded around the camera as it moves, and unloaded 2 chunks past renderDistance
+        ChunkStreamer chunkStreamer(&chunkManager, &chunkUpdater, renderDistance, renderDistance + 2, -5, -1);
 
         // ======= Selection =======
         
@@ -249,9 +292,9 @@ namespace Voxels {
                     vec3 coords = ChunkManager::getChunkCoords(selection.position);
                     vec3 local = ChunkManager::getLocalCoords(selection.position);
 
-                    int oldNumChunks = chunkManager.chunks.size();
+                    int oldNumChunks = chunkManager.numChunks();
                     chunkManager.setVoxelGlobal(selection.position, blockId);
-                    int newNumChunks = chunkManager.chunks.size();
+                    int newNumChunks = chunkManager.numChunks();
                     if (newNumChunks > oldNumChunks) std::cout << "Num Chunks: " << newNumChunks << std::endl;
 
                     chunkUpdater.buildQueue.push(ChunkManager::coordsToId(coords));
@@ -262,20 +305,44 @@ namespace Voxels {
                 }
             }
 
-            chunkUpdater.mapNextAll();
+            if (toggleGreedy) {
+                chunkUpdater.greedyMeshing = !chunkUpdater.greedyMeshing;
+                chunkUpdater.rebuildAllChunks();
+                toggleGreedy = false;
+            }
+            if (cycleLayout) {
+                chunkUpdater.meshLayout = (chunkUpdater.meshLayout + 1) % NUM_MESH_LAYOUTS;
+                // Pages are too big for this driver's buffer textures, so FACES would read past the end of them
+                if (chunkUpdater.meshLayout == FACES && !chunkManager.vertexArena.supportsFaces()) chunkUpdater.meshLayout = (FACES + 1) % NUM_MESH_LAYOUTS;
+                chunkUpdater.rebuildAllChunks();
+                cycleLayout = false;
+            }
+            chunkUpdater.uploadMeshes();
             
             Controls::update(window, &camera, deltaTime, 12, 25, 0.001);
             camera.updateMatrices();
             selection.updateMatrices();
+            chunkUpdater.setCamera(&camera, &frustum);
+            chunkStreamer.update(camera.position);
 
 
             glClearColor(0.25, 0.25, 0.25, 1);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            glUseProgram(chunkProgram);
-            chunkManager.drawChunks(&camera, projectionMatrix, &frustum);
+            // Once per frame instead of once per program
+            for (int i = 0; i < 16; i++) {
+                cameraBlock[i] = camera.inverseWorldMatrix.elements[i];
+                cameraBlock[16 + i] = projectionMatrix.elements[i];
+            }
+            cameraBlock[32] = camera.position.x;
+            cameraBlock[33] = camera.position.y;
+            cameraBlock[34] = camera.position.z;
+            glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(cameraBlock), cameraBlock);
+
+            int numVerts = chunkManager.drawChunks(&camera, &frustum);
 
-            glUseProgram(boxWireframeProgram);
+            useProgram(boxWireframeProgram);
             glBindVertexArray(boxWireframeVAO);
 
             selection.setDefaultUniforms(&camera, projectionMatrix);
@@ -295,7 +362,7 @@ namespace Voxels {
             skybox.draw(&camera, projectionMatrix);
             
             glDisable(GL_DEPTH_TEST);
-            glUseProgram(crosshairProgram);
+            useProgram(crosshairProgram);
             glDrawArrays(GL_LINES, 0, 4);
             glEnable(GL_DEPTH_TEST);
 
@@ -310,6 +377,41 @@ namespace Voxels {
             debugText.updateText(ss.str());
             debugText.draw(aspect);
 
+            // "mesh cpu: xxx.x MB, gpu: xxx.x/xxx.x MB, frag: xxx%" : ~51 chars
+            VertexArena &arena = chunkManager.vertexArena;
+            std::ostringstream ms;
+            ms << "mesh cpu: " << std::fixed << std::setprecision(1) << chunkUpdater.cpuMeshBytes / 1048576.0
+               << " MB, gpu: " << arena.usedBytes / 1048576.0 << "/" << arena.capacityBytes() / 1048576.0
+               << " MB, frag: " << std::setprecision(0) << arena.fragmentation() * 100.0 << "%";
+
+            memoryText.scale = debugText.scale;
+            memoryText.offset.y = 1.0 - debugText.scale.y; // One line below debugText
+            memoryText.updateText(ms.str());
+            memoryText.draw(aspect);
+
+            // "mesher: per-face, layout: triangles, verts: xxxxxxx, frame: xx.xx ms" : ~68 chars
+            const char* layoutNames[NUM_MESH_LAYOUTS] = { "triangles", "quads", "faces" };
+            bool greedy = chunkUpdater.greedyMeshing && chunkUpdater.meshLayout != FACES;
+            std::ostringstream ts;
+            ts << "mesher: " << (greedy ? "greedy" : "per-face") << ", layout: " << layoutNames[chunkUpdater.meshLayout] << ", verts: " << numVerts
+               << ", frame: " << std::fixed << std::setprecision(2) << deltaTime * 1000.0 << " ms";
+
+            meshText.scale = debugText.scale;
+            meshText.offset.y = 1.0 - debugText.scale.y * 2.0;
+            meshText.updateText(ts.str());
+            meshText.draw(aspect);
+
+            // "upload: xxxx chunks, xxxxx.x KB, xx.xx ms, backlog: xxxxx" : ~56 chars
+            UploadStats &upload = chunkUpdater.lastUpload;
+            std::ostringstream us;
+            us << "upload: " << upload.chunks << " chunks, " << std::fixed << std::setprecision(1) << upload.bytes / 1024.0
+               << " KB, " << std::setprecision(2) << upload.ms << " ms, backlog: " << upload.backlog;
+
+            uploadText.scale = debugText.scale;
+            uploadText.offset.y = 1.0 - debugText.scale.y * 3.0;
+            uploadText.updateText(us.str());
+            uploadText.draw(aspect);
+
             glfwSwapBuffers(window);
         }
 
@@ -320,18 +422,21 @@ int main() {
     if (Voxels::init()) return -1;
 
     std::thread thread1(Voxels::render);
-    std::thread thread2(Voxels::chunkFillThread);
+    std::vector<std::thread> fillThreads;
+    for (int i = 0; i < Voxels::chunkUpdater.numFillWorkers; i++) fillThreads.push_back(std::thread(Voxels::chunkFillThread));
     std::thread thread3(Voxels::chunkPopulateThread);
-    std::thread thread4(Voxels::chunkGeoThread);
+    std::vector<std::thread> geoThreads;
+    for (int i = 0; i < Voxels::chunkUpdater.numMeshWorkers; i++) geoThreads.push_back(std::thread(Voxels::chunkGeoThread, i));
 
     while(!glfwWindowShouldClose(Voxels::window)) {
         glfwWaitEvents();
     }
+    Voxels::chunkUpdater.shutdown();
 
     thread1.join();
-    thread2.join();
+    for (int i = 0; i < fillThreads.size(); i++) fillThreads[i].join();
     thread3.join();
-    thread4.join();
+    for (int i = 0; i < geoThreads.size(); i++) geoThreads[i].join();
 
     glfwTerminate();
     return 0;